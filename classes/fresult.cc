@@ -0,0 +1,392 @@
+#include "fresult.h"
+
+#include "ext/spl/spl_array.h"
+
+typedef struct _php_fasttext_result_iterator {
+    zend_object_iterator it;
+    size_t pos;
+    zval current;
+} php_fasttext_result_iterator;
+
+/* {{{ static croco::CResult *php_fasttext_result(zval *object)
+ */
+static croco::CResult *php_fasttext_result(zval *object)
+{
+    return static_cast<croco::CResult*>(Z_FASTTEXT_RESULT_P(object)->handle);
+}
+/* }}} */
+
+/* {{{ static void php_fasttext_result_row(const croco::CResult& result, size_t idx, zval *row)
+ */
+static void php_fasttext_result_row(const croco::CResult& result, size_t idx, zval *row)
+{
+    array_init(row);
+
+    if (croco::CResult::KIND_NGRAM == result.kind()) {
+        const std::pair<std::string, fasttext::Vector> &node = result.ngrams()[idx];
+        zval vecsVal, wordVal;
+
+        array_init_size(&vecsVal, static_cast<uint32_t>(node.second.size()));
+        for (int64_t vidx = 0; vidx < node.second.size(); vidx++) {
+            zval vecVal;
+            ZVAL_DOUBLE(&vecVal, node.second[vidx]);
+            add_index_zval(&vecsVal, vidx, &vecVal);
+        }
+        ZVAL_STRINGL(&wordVal, node.first.c_str(), node.first.size());
+
+        zend_hash_str_add(Z_ARRVAL_P(row), "vectors", sizeof("vectors")-1, &vecsVal);
+        zend_hash_str_add(Z_ARRVAL_P(row), "word", sizeof("word")-1, &wordVal);
+        return;
+    }
+
+    const std::pair<fasttext::real, std::string> &node = result.scores()[idx];
+    zval scoreVal, labelVal;
+
+    ZVAL_DOUBLE(&scoreVal, node.first);
+    ZVAL_STRINGL(&labelVal, node.second.c_str(), node.second.size());
+    if (croco::CResult::KIND_PROB == result.kind()) {
+        zend_hash_str_add(Z_ARRVAL_P(row), "prob", sizeof("prob")-1, &scoreVal);
+    } else {
+        zend_hash_str_add(Z_ARRVAL_P(row), "score", sizeof("score")-1, &scoreVal);
+    }
+    zend_hash_str_add(Z_ARRVAL_P(row), "label", sizeof("label")-1, &labelVal);
+}
+/* }}} */
+
+/* {{{ static void php_fasttext_result_array(const croco::CResult& result, zval *return_value)
+ */
+static void php_fasttext_result_array(const croco::CResult& result, zval *return_value)
+{
+    array_init_size(return_value, static_cast<uint32_t>(result.size()));
+    for (size_t idx = 0; idx < result.size(); idx++) {
+        zval rowVal;
+        php_fasttext_result_row(result, idx, &rowVal);
+        add_index_zval(return_value, idx, &rowVal);
+    }
+}
+/* }}} */
+
+/* {{{ static bool php_fasttext_result_offset(const croco::CResult& result, zval *offset, size_t& idx)
+ */
+static bool php_fasttext_result_offset(const croco::CResult& result, zval *offset, size_t& idx)
+{
+    zend_long lval;
+
+    switch (Z_TYPE_P(offset)) {
+        case IS_LONG:
+            lval = Z_LVAL_P(offset);
+            break;
+        case IS_STRING:
+            if (IS_LONG != is_numeric_string(Z_STRVAL_P(offset), Z_STRLEN_P(offset), &lval, NULL, 0)) {
+                return false;
+            }
+            break;
+        case IS_DOUBLE:
+            lval = zend_dval_to_lval(Z_DVAL_P(offset));
+            break;
+        default:
+            return false;
+    }
+
+    if (0 > lval || result.size() <= static_cast<size_t>(lval)) {
+        return false;
+    }
+    idx = static_cast<size_t>(lval);
+
+    return true;
+}
+/* }}} */
+
+/* {{{ void php_fasttext_result_init(zval *object, croco::CResult *result)
+ */
+void php_fasttext_result_init(zval *object, croco::CResult *result)
+{
+    object_init_ex(object, php_fasttext_result_sc_entry);
+    Z_FASTTEXT_RESULT_P(object)->handle = static_cast<FastTextResultHandle>(result);
+}
+/* }}} */
+
+/* {{{ void php_fasttext_result_free(FastTextResultHandle handle)
+ */
+void php_fasttext_result_free(FastTextResultHandle handle)
+{
+    delete static_cast<croco::CResult*>(handle);
+}
+/* }}} */
+
+/* {{{ fastTextResult iterator
+ */
+static void php_fasttext_result_it_invalidate_current(zend_object_iterator *iter)
+{
+    php_fasttext_result_iterator *iterator = reinterpret_cast<php_fasttext_result_iterator*>(iter);
+
+    zval_ptr_dtor(&iterator->current);
+    ZVAL_UNDEF(&iterator->current);
+}
+
+static void php_fasttext_result_it_dtor(zend_object_iterator *iter)
+{
+    php_fasttext_result_it_invalidate_current(iter);
+    zval_ptr_dtor(&iter->data);
+}
+
+static int php_fasttext_result_it_valid(zend_object_iterator *iter)
+{
+    php_fasttext_result_iterator *iterator = reinterpret_cast<php_fasttext_result_iterator*>(iter);
+    croco::CResult *result = php_fasttext_result(&iter->data);
+
+    return (NULL != result && iterator->pos < result->size()) ? SUCCESS : FAILURE;
+}
+
+static zval *php_fasttext_result_it_get_current_data(zend_object_iterator *iter)
+{
+    php_fasttext_result_iterator *iterator = reinterpret_cast<php_fasttext_result_iterator*>(iter);
+
+    if (Z_ISUNDEF(iterator->current)) {
+        php_fasttext_result_row(*php_fasttext_result(&iter->data), iterator->pos, &iterator->current);
+    }
+    return &iterator->current;
+}
+
+static void php_fasttext_result_it_get_current_key(zend_object_iterator *iter, zval *key)
+{
+    php_fasttext_result_iterator *iterator = reinterpret_cast<php_fasttext_result_iterator*>(iter);
+
+    ZVAL_LONG(key, static_cast<zend_long>(iterator->pos));
+}
+
+static void php_fasttext_result_it_move_forward(zend_object_iterator *iter)
+{
+    php_fasttext_result_iterator *iterator = reinterpret_cast<php_fasttext_result_iterator*>(iter);
+
+    php_fasttext_result_it_invalidate_current(iter);
+    iterator->pos++;
+}
+
+static void php_fasttext_result_it_rewind(zend_object_iterator *iter)
+{
+    php_fasttext_result_iterator *iterator = reinterpret_cast<php_fasttext_result_iterator*>(iter);
+
+    php_fasttext_result_it_invalidate_current(iter);
+    iterator->pos = 0;
+}
+
+static zend_object_iterator_funcs php_fasttext_result_it_funcs = {
+    php_fasttext_result_it_dtor,
+    php_fasttext_result_it_valid,
+    php_fasttext_result_it_get_current_data,
+    php_fasttext_result_it_get_current_key,
+    php_fasttext_result_it_move_forward,
+    php_fasttext_result_it_rewind,
+    php_fasttext_result_it_invalidate_current
+};
+/* }}} */
+
+/* {{{ zend_object_iterator *php_fasttext_result_get_iterator(zend_class_entry *ce, zval *object, int by_ref)
+ */
+zend_object_iterator *php_fasttext_result_get_iterator(zend_class_entry *ce, zval *object, int by_ref)
+{
+    if (by_ref) {
+        zend_throw_error(NULL, "An iterator cannot be used with foreach by reference");
+        return NULL;
+    }
+
+    php_fasttext_result_iterator *iterator =
+        static_cast<php_fasttext_result_iterator*>(emalloc(sizeof(php_fasttext_result_iterator)));
+    zend_iterator_init(&iterator->it);
+
+    ZVAL_COPY(&iterator->it.data, object);
+    iterator->it.funcs = &php_fasttext_result_it_funcs;
+    iterator->pos = 0;
+    ZVAL_UNDEF(&iterator->current);
+
+    return &iterator->it;
+}
+/* }}} */
+
+/* {{{ proto void fastTextResult::__construct()
+ */
+PHP_METHOD(fasttextresult, __construct)
+{
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+}
+/* }}} */
+
+/* {{{ proto bool fastTextResult::offsetExists(mixed offset)
+ */
+PHP_METHOD(fasttextresult, offsetExists)
+{
+    zval *object = getThis();
+    zval *offset;
+    size_t idx;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "z", &offset)) {
+        return;
+    }
+
+    croco::CResult *result = php_fasttext_result(object);
+    if (NULL == result) {
+        RETURN_FALSE;
+    }
+
+    RETURN_BOOL(php_fasttext_result_offset(*result, offset, idx));
+}
+/* }}} */
+
+/* {{{ proto mixed fastTextResult::offsetGet(mixed offset)
+ */
+PHP_METHOD(fasttextresult, offsetGet)
+{
+    zval *object = getThis();
+    zval *offset;
+    size_t idx;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "z", &offset)) {
+        return;
+    }
+
+    croco::CResult *result = php_fasttext_result(object);
+    if (NULL == result || !php_fasttext_result_offset(*result, offset, idx)) {
+        RETURN_NULL();
+    }
+
+    php_fasttext_result_row(*result, idx, return_value);
+}
+/* }}} */
+
+/* {{{ proto void fastTextResult::offsetSet(mixed offset, mixed value)
+ */
+PHP_METHOD(fasttextresult, offsetSet)
+{
+    zval *offset, *value;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "zz", &offset, &value)) {
+        return;
+    }
+
+    zend_throw_exception(zend_ce_exception, "fastTextResult is read-only", 0);
+}
+/* }}} */
+
+/* {{{ proto void fastTextResult::offsetUnset(mixed offset)
+ */
+PHP_METHOD(fasttextresult, offsetUnset)
+{
+    zval *offset;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "z", &offset)) {
+        return;
+    }
+
+    zend_throw_exception(zend_ce_exception, "fastTextResult is read-only", 0);
+}
+/* }}} */
+
+/* {{{ proto long fastTextResult::count()
+ */
+PHP_METHOD(fasttextresult, count)
+{
+    zval *object = getThis();
+
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    croco::CResult *result = php_fasttext_result(object);
+
+    RETURN_LONG(NULL == result ? 0 : static_cast<zend_long>(result->size()));
+}
+/* }}} */
+
+/* {{{ proto ArrayIterator fastTextResult::getIterator()
+ */
+PHP_METHOD(fasttextresult, getIterator)
+{
+    zval *object = getThis();
+    zval rowsVal;
+
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    /* foreach uses the native iterator, this is only reached by explicit calls */
+    croco::CResult *result = php_fasttext_result(object);
+    if (NULL == result) {
+        array_init(&rowsVal);
+    } else {
+        php_fasttext_result_array(*result, &rowsVal);
+    }
+
+    object_init_ex(return_value, spl_ce_ArrayIterator);
+    zend_call_method_with_1_params(return_value, spl_ce_ArrayIterator,
+        &spl_ce_ArrayIterator->constructor, "__construct", NULL, &rowsVal);
+    zval_ptr_dtor(&rowsVal);
+}
+/* }}} */
+
+/* {{{ proto mixed fastTextResult::topLabel()
+ */
+PHP_METHOD(fasttextresult, topLabel)
+{
+    zval *object = getThis();
+
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    croco::CResult *result = php_fasttext_result(object);
+    if (NULL == result || 0 == result->size()) {
+        RETURN_FALSE;
+    }
+
+    if (croco::CResult::KIND_NGRAM == result->kind()) {
+        const std::string &word = result->ngrams().front().first;
+        RETURN_STRINGL(word.c_str(), word.size());
+    }
+
+    const std::string &label = result->scores().front().second;
+    RETURN_STRINGL(label.c_str(), label.size());
+}
+/* }}} */
+
+/* {{{ proto mixed fastTextResult::topScore()
+ */
+PHP_METHOD(fasttextresult, topScore)
+{
+    zval *object = getThis();
+
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    croco::CResult *result = php_fasttext_result(object);
+    if (NULL == result || 0 == result->size() ||
+        croco::CResult::KIND_NGRAM == result->kind()) {
+        RETURN_FALSE;
+    }
+
+    RETURN_DOUBLE(result->scores().front().first);
+}
+/* }}} */
+
+/* {{{ proto array fastTextResult::toArray()
+ */
+PHP_METHOD(fasttextresult, toArray)
+{
+    zval *object = getThis();
+
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    croco::CResult *result = php_fasttext_result(object);
+    if (NULL == result) {
+        array_init(return_value);
+        return;
+    }
+
+    php_fasttext_result_array(*result, return_value);
+}
+/* }}} */
@@ -0,0 +1,60 @@
+#ifndef PHP_CLASSES_FRESULT_H
+#define PHP_CLASSES_FRESULT_H
+
+#include <string.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+
+#include "cresult.h"
+
+extern "C" {
+
+#include "php.h"
+#include "php_ini.h"
+#include "main/SAPI.h"
+
+#include "zend_exceptions.h"
+#include "zend_interfaces.h"
+#include "SAPI.h"
+#include "php_fasttext.h"
+
+#endif /* __cplusplus */
+
+typedef void *FastTextResultHandle;
+
+typedef struct _php_fasttext_result_object {
+    FastTextResultHandle handle;
+    zend_object zo;
+} php_fasttext_result_object;
+
+static inline php_fasttext_result_object *php_fasttext_result_from_obj(zend_object *obj) {
+    return (php_fasttext_result_object*)((char*)(obj) - XtOffsetOf(php_fasttext_result_object, zo));
+}
+
+#define Z_FASTTEXT_RESULT_P(zv) php_fasttext_result_from_obj(Z_OBJ_P((zv)))
+
+PHP_METHOD(fasttextresult, __construct);
+PHP_METHOD(fasttextresult, offsetExists);
+PHP_METHOD(fasttextresult, offsetGet);
+PHP_METHOD(fasttextresult, offsetSet);
+PHP_METHOD(fasttextresult, offsetUnset);
+PHP_METHOD(fasttextresult, count);
+PHP_METHOD(fasttextresult, getIterator);
+PHP_METHOD(fasttextresult, topLabel);
+PHP_METHOD(fasttextresult, topScore);
+PHP_METHOD(fasttextresult, toArray);
+
+extern zend_class_entry *php_fasttext_result_sc_entry;
+
+void php_fasttext_result_free(FastTextResultHandle handle);
+zend_object_iterator *php_fasttext_result_get_iterator(zend_class_entry *ce, zval *object, int by_ref);
+
+#ifdef __cplusplus
+}   // extern "C"
+
+void php_fasttext_result_init(zval *object, croco::CResult *result);
+
+#endif /* __cplusplus */
+
+#endif /* PHP_CLASSES_FRESULT_H */
@@ -1,4 +1,315 @@
 #include "ftext.h"
+#include "fresult.h"
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+
+typedef std::shared_ptr<croco::CFastText> CFastTextPtr;
+typedef std::shared_ptr<croco::CModelEntry> CModelEntryPtr;
+
+static croco::CWorkerPool *php_fasttext_pool = NULL;
+static std::mutex php_fasttext_pool_mutex;
+
+/* {{{ static croco::CWorkerPool& php_fasttext_get_pool()
+ */
+static croco::CWorkerPool& php_fasttext_get_pool()
+{
+    std::lock_guard<std::mutex> lock(php_fasttext_pool_mutex);
+    if (NULL == php_fasttext_pool) {
+        php_fasttext_pool = new croco::CWorkerPool(static_cast<size_t>(MAX(1, FASTTEXT_G(threads))));
+    }
+    return *php_fasttext_pool;
+}
+/* }}} */
+
+/* {{{ void php_fasttext_shutdown()
+ */
+void php_fasttext_shutdown(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(php_fasttext_pool_mutex);
+        delete php_fasttext_pool;
+        php_fasttext_pool = NULL;
+    }
+    croco::CModelRegistry::instance().clear();
+}
+/* }}} */
+
+/* {{{ static CFastTextPtr php_fasttext_model(php_fasttext_object *ft_obj)
+ */
+static CFastTextPtr php_fasttext_model(php_fasttext_object *ft_obj)
+{
+    CModelEntryPtr &entry = *static_cast<CModelEntryPtr*>(ft_obj->handle);
+
+    try {
+        return croco::CModelRegistry::instance().acquire(entry);
+    } catch (std::exception& e) {
+        /* an evicted model could not be loaded again */
+        ZVAL_STRING(&ft_obj->error, e.what());
+    }
+    return CFastTextPtr();
+}
+/* }}} */
+
+/* {{{ static const void *php_fasttext_probe_id(php_fasttext_object *ft_obj)
+ */
+static const void *php_fasttext_probe_id(php_fasttext_object *ft_obj)
+{
+    if (NULL == ft_obj || NULL == ft_obj->handle) {
+        return NULL;
+    }
+    return static_cast<CModelEntryPtr*>(ft_obj->handle)->get();
+}
+/* }}} */
+
+#define PHP_FASTTEXT_PROBE(name, ft_obj, len, k) \
+    croco::CProbe method_probe(croco::CProbe::SCOPE_METHOD, name, php_fasttext_probe_id(ft_obj), len, k)
+
+/* {{{ static CFastTextPtr php_fasttext_new_model()
+ */
+static CFastTextPtr php_fasttext_new_model()
+{
+    CFastTextPtr fasttext = std::make_shared<croco::CFastText>();
+    fasttext->setCacheCapacity(static_cast<size_t>(MAX(0, FASTTEXT_G(oov_cache_size))));
+    return fasttext;
+}
+/* }}} */
+
+/* {{{ static void php_fasttext_load_options(HashTable *ht, croco::CFastText::load_options_t& options)
+ */
+static void php_fasttext_load_options(HashTable *ht, croco::CFastText::load_options_t& options)
+{
+    zval *val;
+
+    if (NULL != (val = zend_hash_str_find(ht, "lazy", sizeof("lazy")-1))) {
+        options.lazy = zend_is_true(val);
+    }
+
+    if (NULL != (val = zend_hash_str_find(ht, "advice", sizeof("advice")-1))) {
+        zend_string *advice = zval_get_string(val);
+        std::string name(ZSTR_VAL(advice), ZSTR_LEN(advice));
+        zend_string_release(advice);
+
+        if ("random" == name) {
+            options.advice = MADV_RANDOM;
+        } else if ("sequential" == name) {
+            options.advice = MADV_SEQUENTIAL;
+        } else if ("willneed" == name) {
+            options.advice = MADV_WILLNEED;
+        } else if ("normal" == name) {
+            options.advice = MADV_NORMAL;
+        } else {
+            throw std::invalid_argument("unknown advice: " + name);
+        }
+    }
+
+    if (NULL != (val = zend_hash_str_find(ht, "threads", sizeof("threads")-1))) {
+        options.threads = static_cast<int>(MAX(0, MIN(zval_get_long(val), 256)));
+    }
+
+    if (NULL != (val = zend_hash_str_find(ht, "warmup", sizeof("warmup")-1)) && Z_TYPE_P(val) == IS_ARRAY) {
+        zval *word;
+        ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(val), word) {
+            zend_string *str = zval_get_string(word);
+            options.warmup.push_back(std::string(ZSTR_VAL(str), ZSTR_LEN(str)));
+            zend_string_release(str);
+        } ZEND_HASH_FOREACH_END();
+    }
+}
+/* }}} */
+
+/* {{{ static void php_fasttext_corpus_append(croco::CTrainCorpus& corpus, zval *line)
+ */
+static void php_fasttext_corpus_append(croco::CTrainCorpus& corpus, zval *line)
+{
+    zend_string *str = zval_get_string(line);
+    corpus.append(ZSTR_VAL(str), ZSTR_LEN(str));
+    zend_string_release(str);
+}
+/* }}} */
+
+/* {{{ static bool php_fasttext_corpus_fill(croco::CTrainCorpus& corpus, zval *input)
+ */
+static bool php_fasttext_corpus_fill(croco::CTrainCorpus& corpus, zval *input)
+{
+    zval *line;
+
+    if (Z_TYPE_P(input) == IS_ARRAY) {
+        ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(input), line) {
+            php_fasttext_corpus_append(corpus, line);
+        } ZEND_HASH_FOREACH_END();
+        corpus.flush();
+        return true;
+    }
+
+    if (Z_TYPE_P(input) != IS_OBJECT || !instanceof_function(Z_OBJCE_P(input), zend_ce_traversable)) {
+        throw std::invalid_argument("input must be a file name, an array or a Traversable");
+    }
+
+    zend_class_entry *ce = Z_OBJCE_P(input);
+    zend_object_iterator *iter = ce->get_iterator(ce, input, 0);
+    if (NULL == iter || EG(exception)) {
+        return false;
+    }
+
+    if (iter->funcs->rewind) {
+        iter->funcs->rewind(iter);
+    }
+    while (!EG(exception) && SUCCESS == iter->funcs->valid(iter)) {
+        line = iter->funcs->get_current_data(iter);
+        if (EG(exception) || NULL == line) {
+            break;
+        }
+        php_fasttext_corpus_append(corpus, line);
+        iter->funcs->move_forward(iter);
+    }
+    zend_iterator_dtor(iter);
+
+    if (EG(exception)) {
+        return false;
+    }
+    corpus.flush();
+    return true;
+}
+/* }}} */
+
+/* {{{ static bool php_fasttext_report(zend_fcall_info *fci, zend_fcall_info_cache *fcc, double progress, double loss)
+ */
+static bool php_fasttext_report(zend_fcall_info *fci, zend_fcall_info_cache *fcc, double progress, double loss)
+{
+    zval params[2], retval;
+
+    ZVAL_DOUBLE(&params[0], progress);
+    ZVAL_DOUBLE(&params[1], loss);
+    fci->params = params;
+    fci->param_count = 2;
+    fci->retval = &retval;
+    if (SUCCESS == zend_call_function(fci, fcc)) {
+        zval_ptr_dtor(&retval);
+    }
+    fci->params = NULL;
+    fci->param_count = 0;
+
+    return !EG(exception);
+}
+/* }}} */
+
+/* {{{ static croco::CAsync *php_fasttext_get_async(php_fasttext_object *ft_obj)
+ */
+static croco::CAsync *php_fasttext_get_async(php_fasttext_object *ft_obj)
+{
+    if (NULL == ft_obj->async) {
+        ft_obj->async = static_cast<FastTextHandle>(new croco::CAsync(php_fasttext_get_pool()));
+    }
+    return static_cast<croco::CAsync*>(ft_obj->async);
+}
+/* }}} */
+
+/* {{{ static void php_fasttext_set_clusters(php_fasttext_object *ft_obj, const croco::CClusterIndex& index)
+ */
+static void php_fasttext_set_clusters(php_fasttext_object *ft_obj, const croco::CClusterIndex& index)
+{
+    croco::CClusterIndex *clusters = new croco::CClusterIndex(index);
+    delete static_cast<croco::CClusterIndex*>(ft_obj->clusters);
+    ft_obj->clusters = static_cast<FastTextHandle>(clusters);
+}
+/* }}} */
+
+/* {{{ static void php_fasttext_scores(zval *return_value, result, key, key_len)
+ */
+static void php_fasttext_scores(zval *return_value, const std::vector<std::pair<fasttext::real, std::string>>& result, const char *key, size_t key_len)
+{
+    array_init(return_value);
+    zend_ulong idx = 0;
+    for (auto &node : result) {
+        zval rowVal, scoreVal, labelVal;
+        array_init(&rowVal);
+        ZVAL_DOUBLE(&scoreVal, node.first);
+        ZVAL_STRING(&labelVal, node.second.c_str());
+        zend_hash_str_add(Z_ARRVAL_P(&rowVal), key, key_len, &scoreVal);
+        zend_hash_str_add(Z_ARRVAL_P(&rowVal), "label", sizeof("label")-1, &labelVal);
+
+        add_index_zval(return_value, idx, &rowVal);
+        idx++;
+    }
+}
+/* }}} */
+
+/* {{{ static void php_fasttext_parallel_for(size_t count, bool parallel, work)
+ */
+static void php_fasttext_parallel_for(size_t count, bool parallel, const std::function<void(size_t, size_t)>& work)
+{
+    size_t chunks = 1;
+    if (parallel) {
+        chunks = MIN(count, php_fasttext_get_pool().size() + 1);
+    }
+    if (1 >= chunks) {
+        work(0, count);
+        return;
+    }
+
+    std::vector<std::future<void>> pending;
+    croco::CWorkerPool &pool = php_fasttext_get_pool();
+    size_t step = (count + chunks - 1) / chunks;
+    for (size_t begin = step; begin < count; begin += step) {
+        auto task = std::make_shared<std::packaged_task<void()>>(std::bind(work, begin, MIN(count, begin + step)));
+        pending.push_back(task->get_future());
+        pool.submit([task]() { (*task)(); });
+    }
+
+    std::exception_ptr error;
+    try {
+        work(0, MIN(count, step));
+    } catch (...) {
+        error = std::current_exception();
+    }
+    for (auto &future : pending) {
+        try {
+            future.get();
+        } catch (...) {
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+/* }}} */
+
+/* {{{ static void php_fasttext_texts(HashTable *ht, std::vector<std::string>& texts)
+ */
+static void php_fasttext_texts(HashTable *ht, std::vector<std::string>& texts)
+{
+    zval *val;
+
+    texts.reserve(zend_hash_num_elements(ht));
+    ZEND_HASH_FOREACH_VAL(ht, val) {
+        zend_string *str = zval_get_string(val);
+        texts.push_back(std::string(ZSTR_VAL(str), ZSTR_LEN(str)));
+        zend_string_release(str);
+    } ZEND_HASH_FOREACH_END();
+}
+/* }}} */
+
+/* {{{ static void php_fasttext_embed(CFastTextPtr fasttext, texts, rows, parallel)
+ */
+static void php_fasttext_embed(CFastTextPtr fasttext, const std::vector<std::string>& texts, std::vector<fasttext::real>& rows, bool parallel)
+{
+    int64_t dim = fasttext->getDimension();
+    rows.resize(texts.size() * dim);
+
+    php_fasttext_parallel_for(texts.size(), parallel, [&fasttext, &texts, &rows, dim](size_t begin, size_t end) {
+        for (size_t idx = begin; idx < end; idx++) {
+            fasttext->embed(texts[idx], rows.data() + idx * dim);
+        }
+    });
+}
+/* }}} */
 
 /* {{{ proto void fasttext::__construct()
  */
@@ -14,9 +325,11 @@ PHP_METHOD(fasttext, __construct)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("__construct", ft_obj, 0, 0);
 
-    croco::CFastText *fasttext = new croco::CFastText();
-    ft_obj->handle = static_cast<FastTextHandle>(fasttext);
+    ft_obj->handle = static_cast<FastTextHandle>(
+        new CModelEntryPtr(std::make_shared<croco::CModelEntry>(php_fasttext_new_model()))
+    );
 }
 /* }}} */
 
@@ -32,9 +345,19 @@ PHP_METHOD(fasttext, __destruct)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("__destruct", ft_obj, 0, 0);
+
+    croco::CAsync *async = static_cast<croco::CAsync*>(ft_obj->async);
+    delete async;
+    ft_obj->async = NULL;
 
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
-    delete fasttext;
+    croco::CClusterIndex *clusters = static_cast<croco::CClusterIndex*>(ft_obj->clusters);
+    delete clusters;
+    ft_obj->clusters = NULL;
+
+    CModelEntryPtr *entry = static_cast<CModelEntryPtr*>(ft_obj->handle);
+    delete entry;
+    ft_obj->handle = NULL;
 }
 /* }}} */
 
@@ -50,12 +373,13 @@ PHP_METHOD(fasttext, getError)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("getError", ft_obj, 0, 0);
 
     RETURN_ZVAL(&ft_obj->error, 1, 0);
 }
 /* }}} */
 
-/* {{{ proto long fasttext::load(String filename)
+/* {{{ proto long fasttext::load(String filename[, array options])
  */
 PHP_METHOD(fasttext, load)
 {
@@ -63,21 +387,67 @@ PHP_METHOD(fasttext, load)
     zval *object = getThis();
     char *model;
     size_t model_len;
+    zval *options = NULL;
 
-    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "s", &model, &model_len)) {
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "s|a", &model, &model_len, &options)) {
         return;
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("load", ft_obj, model_len, 0);
 
+    /* tasks in flight keep their own reference to the previous model */
+    CModelEntryPtr entry;
     try {
-         fasttext->loadModel(std::string(model));
+        croco::CFastText::load_options_t opts;
+        bool pin = false;
+        if (NULL != options) {
+            php_fasttext_load_options(Z_ARRVAL_P(options), opts);
+
+            zval *val = zend_hash_str_find(Z_ARRVAL_P(options), "pin", sizeof("pin")-1);
+            pin = (NULL != val) && zend_is_true(val);
+        }
+
+        std::string filename(model, model_len);
+        if (FASTTEXT_G(share_models)) {
+            croco::CModelRegistry &registry = croco::CModelRegistry::instance();
+            size_t oovCacheSize = static_cast<size_t>(MAX(0, FASTTEXT_G(oov_cache_size)));
+            std::string path;
+            std::string identity = croco::CModelRegistry::identify(filename, path);
+            bool found = false;
+
+            registry.setBudget(static_cast<size_t>(MAX(0, FASTTEXT_G(cache_budget))));
+            entry = registry.entry(
+                opts.lazy ? path + "#lazy" : path,
+                path,
+                identity,
+                [path, opts, oovCacheSize]() {
+                    /* may run again on any thread after an eviction */
+                    CFastTextPtr shared = std::make_shared<croco::CFastText>();
+                    shared->setCacheCapacity(oovCacheSize);
+                    shared->loadModel(path, opts);
+                    return shared;
+                },
+                pin,
+                &found
+            );
+            CFastTextPtr shared = registry.acquire(entry);
+            if (found) {
+                /* the hints of this caller, the model itself was loaded by another */
+                shared->advise(opts);
+            }
+        } else {
+            CFastTextPtr fasttext = php_fasttext_new_model();
+            fasttext->loadModel(filename, opts);
+            entry = std::make_shared<croco::CModelEntry>(fasttext);
+        }
     } catch (std::exception& e) {
         ZVAL_STRING(&ft_obj->error, e.what());
         RETURN_FALSE;
     }
 
+    *static_cast<CModelEntryPtr*>(ft_obj->handle) = entry;
+
     RETURN_TRUE;
 }
 /* }}} */
@@ -95,7 +465,11 @@ PHP_METHOD(fasttext, getWordRows)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getWordRows", ft_obj, 0, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     try {
         std::shared_ptr<const fasttext::Dictionary> dict = fasttext->getDictionary();
@@ -122,7 +496,11 @@ PHP_METHOD(fasttext, getLabelRows)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getLabelRows", ft_obj, 0, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     try {
         std::shared_ptr<const fasttext::Dictionary> dict = fasttext->getDictionary();
@@ -151,7 +529,11 @@ PHP_METHOD(fasttext, getWordId)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getWordId", ft_obj, word_len, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     try {
         id = fasttext->getWordId(std::string(word));
@@ -179,7 +561,11 @@ PHP_METHOD(fasttext, getSubwordId)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getSubwordId", ft_obj, word_len, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     try {
         id = fasttext->getSubwordId(std::string(word));
@@ -205,7 +591,11 @@ PHP_METHOD(fasttext, getWord)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getWord", ft_obj, 0, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     try {
         std::shared_ptr<const fasttext::Dictionary> dict = fasttext->getDictionary();
@@ -231,7 +621,11 @@ PHP_METHOD(fasttext, getLabel)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getLabel", ft_obj, 0, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     try {
         std::shared_ptr<const fasttext::Dictionary> dict = fasttext->getDictionary();
@@ -258,7 +652,11 @@ PHP_METHOD(fasttext, getWordVectors)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getWordVectors", ft_obj, word_len, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     fasttext::Vector vec(fasttext->getDimension());
     try {
@@ -294,7 +692,11 @@ PHP_METHOD(fasttext, getSubwordVector)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getSubwordVector", ft_obj, word_len, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     fasttext::Vector vec(fasttext->getDimension());
     try {
@@ -330,7 +732,11 @@ PHP_METHOD(fasttext, getSentenceVectors)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getSentenceVectors", ft_obj, sentence_len, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     std::stringbuf strBuf(sentence);
     std::istream istream(&strBuf); 
@@ -370,7 +776,11 @@ PHP_METHOD(fasttext, getPredict)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getPredict", ft_obj, word_len, k);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     std::vector<std::pair<fasttext::real, std::string>> result;
     try {
@@ -383,12 +793,18 @@ PHP_METHOD(fasttext, getPredict)
         RETURN_FALSE;
     }
 
+    croco::CProbe result_probe(croco::CProbe::SCOPE_PHASE, "result", fasttext.get(), result.size());
+    if (ft_obj->lazy_results) {
+        php_fasttext_result_init(return_value, new croco::CResult(croco::CResult::KIND_PROB, std::move(result)));
+        return;
+    }
+
     array_init(return_value);
     zend_ulong idx = 0;
     for (auto &node : result) {
         zval rowVal, probVal, labelVal;
         array_init(&rowVal);
-        ZVAL_DOUBLE(&probVal, std::exp(node.first));
+        ZVAL_DOUBLE(&probVal, node.first);
         ZVAL_STRING(&labelVal, node.second.c_str());
         zend_hash_str_add(Z_ARRVAL_P(&rowVal), "prob", sizeof("prob")-1, &probVal);
         zend_hash_str_add(Z_ARRVAL_P(&rowVal), "label", sizeof("label")-1, &labelVal);
@@ -413,7 +829,11 @@ PHP_METHOD(fasttext, getNgrams)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getNgrams", ft_obj, word_len, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     std::vector<std::pair<std::string, fasttext::Vector>> result;
     try {
@@ -423,6 +843,12 @@ PHP_METHOD(fasttext, getNgrams)
         RETURN_FALSE;
     }
 
+    croco::CProbe result_probe(croco::CProbe::SCOPE_PHASE, "result", fasttext.get(), result.size());
+    if (ft_obj->lazy_results) {
+        php_fasttext_result_init(return_value, new croco::CResult(std::move(result)));
+        return;
+    }
+
     array_init(return_value);
     zend_ulong idx = 0;
     for (auto &node : result) {
@@ -462,7 +888,11 @@ PHP_METHOD(fasttext, getNN)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getNN", ft_obj, word_len, k);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     std::vector<std::pair<fasttext::real, std::string>> result;
     try {
@@ -475,6 +905,12 @@ PHP_METHOD(fasttext, getNN)
         RETURN_FALSE;
     }
 
+    croco::CProbe result_probe(croco::CProbe::SCOPE_PHASE, "result", fasttext.get(), result.size());
+    if (ft_obj->lazy_results) {
+        php_fasttext_result_init(return_value, new croco::CResult(croco::CResult::KIND_SCORE, std::move(result)));
+        return;
+    }
+
     array_init(return_value);
     zend_ulong idx = 0;
     for (auto &node : result) {
@@ -507,7 +943,11 @@ PHP_METHOD(fasttext, getAnalogies)
     }
 
     ft_obj = Z_FASTTEXT_P(object);
-    croco::CFastText *fasttext = static_cast<croco::CFastText*>(ft_obj->handle);
+    PHP_FASTTEXT_PROBE("getAnalogies", ft_obj, word_len, k);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
 
     std::vector<std::pair<fasttext::real, std::string>> result;
     try {
@@ -521,6 +961,12 @@ PHP_METHOD(fasttext, getAnalogies)
         RETURN_FALSE;
     }
 
+    croco::CProbe result_probe(croco::CProbe::SCOPE_PHASE, "result", fasttext.get(), result.size());
+    if (ft_obj->lazy_results) {
+        php_fasttext_result_init(return_value, new croco::CResult(croco::CResult::KIND_SCORE, std::move(result)));
+        return;
+    }
+
     array_init(return_value);
     zend_ulong idx = 0;
 
@@ -537,3 +983,1026 @@ PHP_METHOD(fasttext, getAnalogies)
     }
 }
 /* }}} */
+
+
+/* {{{ proto array fasttext::getCacheStats()
+ */
+PHP_METHOD(fasttext, getCacheStats)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("getCacheStats", ft_obj, 0, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
+
+    zval wordsVal, ngramsVal;
+    croco::CLruCache<fasttext::Vector> &words = fasttext->getWordCache();
+    array_init(&wordsVal);
+    add_assoc_long(&wordsVal, "hits", static_cast<zend_long>(words.hits()));
+    add_assoc_long(&wordsVal, "misses", static_cast<zend_long>(words.misses()));
+    add_assoc_long(&wordsVal, "size", static_cast<zend_long>(words.size()));
+    add_assoc_long(&wordsVal, "capacity", static_cast<zend_long>(words.capacity()));
+    add_assoc_long(&wordsVal, "bytes", static_cast<zend_long>(words.bytes()));
+
+    croco::CLruCache<croco::CFastText::subwords_t> &ngrams = fasttext->getNgramCache();
+    array_init(&ngramsVal);
+    add_assoc_long(&ngramsVal, "hits", static_cast<zend_long>(ngrams.hits()));
+    add_assoc_long(&ngramsVal, "misses", static_cast<zend_long>(ngrams.misses()));
+    add_assoc_long(&ngramsVal, "size", static_cast<zend_long>(ngrams.size()));
+    add_assoc_long(&ngramsVal, "capacity", static_cast<zend_long>(ngrams.capacity()));
+    add_assoc_long(&ngramsVal, "bytes", static_cast<zend_long>(ngrams.bytes()));
+
+    array_init(return_value);
+    zend_hash_str_add(Z_ARRVAL_P(return_value), "words", sizeof("words")-1, &wordsVal);
+    zend_hash_str_add(Z_ARRVAL_P(return_value), "ngrams", sizeof("ngrams")-1, &ngramsVal);
+}
+/* }}} */
+
+/* {{{ proto int fasttext::submitPredict(String word[, int k])
+ */
+PHP_METHOD(fasttext, submitPredict)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    char *word;
+    size_t word_len;
+    zend_long k = 0;
+    zend_long id;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "s|l", &word, &word_len, &k)) {
+        return;
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("submitPredict", ft_obj, word_len, k);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
+
+    try {
+        if (0 >= k) {
+            k = fasttext->getK();
+        }
+        std::string text(word, word_len);
+        int32_t topk = static_cast<int32_t>(k);
+        id = php_fasttext_get_async(ft_obj)->submit(
+            croco::CAsync::KIND_PREDICT,
+            [fasttext, topk, text]() { return fasttext->getPredict(topk, text); }
+        );
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    RETURN_LONG(id);
+}
+/* }}} */
+
+/* {{{ proto int fasttext::submitNN(String word[, int k])
+ */
+PHP_METHOD(fasttext, submitNN)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    char *word;
+    size_t word_len;
+    zend_long k = 0;
+    zend_long id;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "s|l", &word, &word_len, &k)) {
+        return;
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("submitNN", ft_obj, word_len, k);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
+
+    try {
+        if (0 >= k) {
+            k = fasttext->getK();
+        }
+
+        /* the word vectors of a fresh model are built by the task, not on this thread */
+        std::string query(word, word_len);
+        int32_t topk = static_cast<int32_t>(k);
+        id = php_fasttext_get_async(ft_obj)->submit(
+            croco::CAsync::KIND_NN,
+            [fasttext, topk, query]() { return fasttext->getNN(query, topk); }
+        );
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    RETURN_LONG(id);
+}
+/* }}} */
+
+/* {{{ proto bool fasttext::poll(int task)
+ */
+PHP_METHOD(fasttext, poll)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    zend_long id;
+    bool done;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "l", &id)) {
+        return;
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("poll", ft_obj, 0, 0);
+
+    try {
+        done = php_fasttext_get_async(ft_obj)->poll(id);
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    RETURN_BOOL(done);
+}
+/* }}} */
+
+/* {{{ proto mixed fasttext::wait(int task[, float timeout])
+ */
+PHP_METHOD(fasttext, wait)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    zend_long id;
+    double timeout = -1.0;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "l|d", &id, &timeout)) {
+        return;
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("wait", ft_obj, 0, 0);
+
+    croco::CAsync::kind_t kind;
+    croco::CAsync::result_t result;
+    try {
+        if (!php_fasttext_get_async(ft_obj)->wait(id, timeout, kind, result)) {
+            RETURN_NULL();
+        }
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    if (croco::CAsync::KIND_PREDICT == kind) {
+        php_fasttext_scores(return_value, result, "prob", sizeof("prob")-1);
+    } else {
+        php_fasttext_scores(return_value, result, "score", sizeof("score")-1);
+    }
+}
+/* }}} */
+
+/* {{{ proto resource fasttext::getNotifyStream()
+ */
+PHP_METHOD(fasttext, getNotifyStream)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    php_stream *stream;
+    int fd;
+
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("getNotifyStream", ft_obj, 0, 0);
+
+    try {
+        fd = dup(php_fasttext_get_async(ft_obj)->notifyFd());
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    stream = (-1 == fd) ? NULL : php_stream_fopen_from_fd(fd, "r", NULL);
+    if (NULL == stream) {
+        if (-1 != fd) {
+            close(fd);
+        }
+        ZVAL_STRING(&ft_obj->error, "cannot open the notification stream");
+        RETURN_FALSE;
+    }
+
+    php_stream_to_zval(stream, return_value);
+}
+/* }}} */
+
+/* {{{ proto bool fasttext::train(array args, mixed input[, callable progress])
+ */
+PHP_METHOD(fasttext, train)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    zval *params, *input;
+    zend_fcall_info fci = empty_fcall_info;
+    zend_fcall_info_cache fcc = empty_fcall_info_cache;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "az|f", &params, &input, &fci, &fcc)) {
+        return;
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("train", ft_obj, 0, 0);
+
+    CFastTextPtr fasttext = php_fasttext_new_model();
+    std::unique_ptr<croco::CTrainCorpus> corpus;
+    fasttext::Args args;
+    try {
+        std::map<std::string, std::string> options;
+        zend_string *key;
+        zval *val;
+        ZEND_HASH_FOREACH_STR_KEY_VAL(Z_ARRVAL_P(params), key, val) {
+            if (NULL == key) {
+                continue;
+            }
+            zend_string *str = zval_get_string(val);
+            options[std::string(ZSTR_VAL(key), ZSTR_LEN(key))] = std::string(ZSTR_VAL(str), ZSTR_LEN(str));
+            zend_string_release(str);
+        } ZEND_HASH_FOREACH_END();
+        args = croco::CFastText::makeArgs(options);
+
+        if (Z_TYPE_P(input) == IS_STRING) {
+            args.input = std::string(Z_STRVAL_P(input), Z_STRLEN_P(input));
+        } else {
+            corpus.reset(new croco::CTrainCorpus());
+            if (!php_fasttext_corpus_fill(*corpus, input)) {
+                return;
+            }
+            args.input = corpus->path();
+        }
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    /* the training threads never call back into PHP, progress is polled from here */
+    std::future<void> done = std::async(std::launch::async, [fasttext, args]() {
+        fasttext->train(args);
+    });
+
+    bool report = ZEND_FCI_INITIALIZED(fci);
+    while (std::future_status::ready != done.wait_for(std::chrono::milliseconds(100))) {
+        if (!report || 0 > fasttext->getTrainLoss()) {
+            continue;
+        }
+
+        report = php_fasttext_report(&fci, &fcc, fasttext->getTrainProgress(), fasttext->getTrainLoss());
+    }
+
+    try {
+        done.get();
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    if (EG(exception)) {
+        return;
+    }
+
+    if (report && !php_fasttext_report(&fci, &fcc, 1.0, fasttext->getTrainLoss())) {
+        return;
+    }
+
+    *static_cast<CModelEntryPtr*>(ft_obj->handle) = std::make_shared<croco::CModelEntry>(fasttext);
+
+    RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto bool fasttext::save(String filename)
+ */
+PHP_METHOD(fasttext, save)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    char *model;
+    size_t model_len;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "s", &model, &model_len)) {
+        return;
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("save", ft_obj, model_len, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
+
+    try {
+        fasttext->saveModel(std::string(model, model_len));
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto array fasttext::predictMulti(array models, String text[, int k[, bool parallel]])
+ */
+PHP_METHOD(fasttext, predictMulti)
+{
+    zval *models;
+    char *text;
+    size_t text_len;
+    zend_long k = 0;
+    zend_bool parallel = 0;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "as|lb", &models, &text, &text_len, &k, &parallel)) {
+        return;
+    }
+
+    PHP_FASTTEXT_PROBE("predictMulti", NULL, text_len, k);
+
+    std::vector<php_fasttext_object*> objects;
+    std::vector<CFastTextPtr> targets;
+    zval *entry;
+    ZEND_HASH_FOREACH_VAL(Z_ARRVAL_P(models), entry) {
+        if (Z_TYPE_P(entry) != IS_OBJECT || !instanceof_function(Z_OBJCE_P(entry), php_fasttext_sc_entry)) {
+            zend_type_error("models must be fastText instances");
+            return;
+        }
+        objects.push_back(Z_FASTTEXT_P(entry));
+        targets.push_back(php_fasttext_model(objects.back()));
+    } ZEND_HASH_FOREACH_END();
+
+    /* tokenise once per distinct dictionary */
+    std::string input(text, text_len);
+    std::map<uint64_t, std::vector<int32_t>> tokens;
+    std::vector<const std::vector<int32_t>*> words(targets.size(), NULL);
+    std::vector<std::string> errors(targets.size());
+    for (size_t idx = 0; idx < targets.size(); idx++) {
+        if (!targets[idx]) {
+            errors[idx] = Z_STRVAL(objects[idx]->error);
+            continue;
+        }
+        try {
+            uint64_t fingerprint = targets[idx]->getDictFingerprint();
+            auto it = tokens.find(fingerprint);
+            if (it == tokens.end()) {
+                it = tokens.emplace(fingerprint, std::vector<int32_t>()).first;
+                targets[idx]->tokenize(input, it->second);
+            }
+            words[idx] = &it->second;
+        } catch (std::exception& e) {
+            errors[idx] = e.what();
+        }
+    }
+
+    typedef std::vector<std::pair<fasttext::real, std::string>> result_t;
+    std::vector<result_t> results(targets.size());
+    auto forward = [&targets, &words, &results, &errors, k](size_t idx) {
+        if (NULL == words[idx]) {
+            return;
+        }
+        try {
+            int32_t topk = (0 >= k) ? targets[idx]->getK() : static_cast<int32_t>(k);
+            results[idx] = targets[idx]->predictWords(topk, *words[idx]);
+        } catch (std::exception& e) {
+            errors[idx] = e.what();
+        }
+    };
+
+    if (parallel && 1 < targets.size()) {
+        std::vector<std::future<void>> pending;
+        croco::CWorkerPool &pool = php_fasttext_get_pool();
+        for (size_t idx = 1; idx < targets.size(); idx++) {
+            auto task = std::make_shared<std::packaged_task<void()>>(std::bind(forward, idx));
+            pending.push_back(task->get_future());
+            pool.submit([task]() { (*task)(); });
+        }
+        forward(0);
+        for (auto &future : pending) {
+            future.wait();
+        }
+    } else {
+        for (size_t idx = 0; idx < targets.size(); idx++) {
+            forward(idx);
+        }
+    }
+
+    croco::CProbe result_probe(croco::CProbe::SCOPE_PHASE, "result", NULL, results.size());
+    array_init(return_value);
+    size_t idx = 0;
+    zend_ulong num;
+    zend_string *key;
+    ZEND_HASH_FOREACH_KEY(Z_ARRVAL_P(models), num, key) {
+        zval rowVal;
+        if (errors[idx].empty()) {
+            php_fasttext_scores(&rowVal, results[idx], "prob", sizeof("prob")-1);
+        } else {
+            ZVAL_STRING(&objects[idx]->error, errors[idx].c_str());
+            ZVAL_FALSE(&rowVal);
+        }
+
+        if (key) {
+            zend_hash_update(Z_ARRVAL_P(return_value), key, &rowVal);
+        } else {
+            zend_hash_index_update(Z_ARRVAL_P(return_value), num, &rowVal);
+        }
+        idx++;
+    } ZEND_HASH_FOREACH_END();
+}
+/* }}} */
+
+/* {{{ proto array fasttext::analyze(String text[, array options])
+ */
+PHP_METHOD(fasttext, analyze)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    char *text;
+    size_t text_len;
+    zval *options = NULL, *val;
+    zend_long k = -1;
+    bool embedding = true, packed = false, tokens = false;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "s|a", &text, &text_len, &options)) {
+        return;
+    }
+
+    if (NULL != options) {
+        if (NULL != (val = zend_hash_str_find(Z_ARRVAL_P(options), "k", sizeof("k")-1))) {
+            k = zval_get_long(val);
+        }
+        if (NULL != (val = zend_hash_str_find(Z_ARRVAL_P(options), "embedding", sizeof("embedding")-1))) {
+            embedding = zend_is_true(val);
+        }
+        if (NULL != (val = zend_hash_str_find(Z_ARRVAL_P(options), "packed", sizeof("packed")-1))) {
+            packed = zend_is_true(val);
+        }
+        if (NULL != (val = zend_hash_str_find(Z_ARRVAL_P(options), "tokens", sizeof("tokens")-1))) {
+            tokens = zend_is_true(val);
+        }
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("analyze", ft_obj, text_len, k);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
+
+    fasttext::Vector vec(fasttext->getDimension());
+    std::vector<std::pair<fasttext::real, std::string>> predictions;
+    std::vector<std::pair<std::string, int32_t>> words;
+    try {
+        if (0 > k) {
+            k = fasttext->getK();
+        }
+        fasttext->analyze(std::string(text, text_len), static_cast<int32_t>(k), vec, predictions, tokens ? &words : NULL);
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    croco::CProbe result_probe(croco::CProbe::SCOPE_PHASE, "result", fasttext.get(), predictions.size());
+    array_init(return_value);
+
+    zval predictVal;
+    php_fasttext_scores(&predictVal, predictions, "prob", sizeof("prob")-1);
+    zend_hash_str_add(Z_ARRVAL_P(return_value), "predictions", sizeof("predictions")-1, &predictVal);
+
+    if (embedding) {
+        zval vecsVal;
+        if (packed) {
+            ZVAL_STRINGL(&vecsVal, reinterpret_cast<const char*>(vec.data()), vec.size() * sizeof(fasttext::real));
+        } else {
+            array_init_size(&vecsVal, static_cast<uint32_t>(vec.size()));
+            for (int64_t idx = 0; idx < vec.size(); idx++) {
+                add_index_double(&vecsVal, idx, vec[idx]);
+            }
+        }
+        zend_hash_str_add(Z_ARRVAL_P(return_value), "embedding", sizeof("embedding")-1, &vecsVal);
+    }
+
+    if (tokens) {
+        zval tokensVal;
+        array_init_size(&tokensVal, static_cast<uint32_t>(words.size()));
+        for (auto &node : words) {
+            zval rowVal;
+            array_init(&rowVal);
+            add_assoc_stringl(&rowVal, "token", const_cast<char*>(node.first.data()), node.first.size());
+            add_assoc_long(&rowVal, "id", node.second);
+            add_assoc_bool(&rowVal, "oov", 0 > node.second);
+            add_next_index_zval(&tokensVal, &rowVal);
+        }
+        zend_hash_str_add(Z_ARRVAL_P(return_value), "tokens", sizeof("tokens")-1, &tokensVal);
+    }
+}
+/* }}} */
+
+/* {{{ proto array fasttext::getModelCacheStats()
+ */
+PHP_METHOD(fasttext, getModelCacheStats)
+{
+    if (zend_parse_parameters_none() == FAILURE) {
+        return;
+    }
+
+    PHP_FASTTEXT_PROBE("getModelCacheStats", NULL, 0, 0);
+
+    croco::CModelRegistry &registry = croco::CModelRegistry::instance();
+
+    zval modelsVal;
+    array_init(&modelsVal);
+    for (auto &node : registry.getStats()) {
+        zval rowVal;
+        array_init(&rowVal);
+        add_assoc_long(&rowVal, "bytes", static_cast<zend_long>(node.bytes));
+        add_assoc_bool(&rowVal, "pinned", node.pinned);
+        add_assoc_bool(&rowVal, "loaded", node.loaded);
+        add_assoc_long(&rowVal, "hits", static_cast<zend_long>(node.hits));
+        add_assoc_long(&rowVal, "loads", static_cast<zend_long>(node.loads));
+        zend_hash_str_update(Z_ARRVAL(modelsVal), node.key.c_str(), node.key.size(), &rowVal);
+    }
+
+    array_init(return_value);
+    add_assoc_long(return_value, "budget", static_cast<zend_long>(registry.getBudget()));
+    add_assoc_long(return_value, "bytes", static_cast<zend_long>(registry.getBytes()));
+    add_assoc_long(return_value, "evictions", static_cast<zend_long>(registry.getEvictions()));
+    add_assoc_long(return_value, "reloads", static_cast<zend_long>(registry.getReloads()));
+    zend_hash_str_add(Z_ARRVAL_P(return_value), "models", sizeof("models")-1, &modelsVal);
+}
+/* }}} */
+
+/* {{{ proto int fasttext::dropModel(String filename)
+ */
+PHP_METHOD(fasttext, dropModel)
+{
+    char *model;
+    size_t model_len;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "s", &model, &model_len)) {
+        return;
+    }
+
+    PHP_FASTTEXT_PROBE("dropModel", NULL, model_len, 0);
+
+    size_t count = croco::CModelRegistry::instance().drop(std::string(model, model_len));
+
+    RETURN_LONG(static_cast<zend_long>(count));
+}
+/* }}} */
+/* {{{ proto bool fasttext::setLazyResults(bool lazy)
+ */
+PHP_METHOD(fasttext, setLazyResults)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    zend_bool lazy;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "b", &lazy)) {
+        return;
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("setLazyResults", ft_obj, 0, 0);
+    zend_bool previous = ft_obj->lazy_results;
+    ft_obj->lazy_results = lazy;
+
+    RETURN_BOOL(previous);
+}
+/* }}} */
+
+/* {{{ proto float fasttext::similarity(String a, String b)
+ */
+PHP_METHOD(fasttext, similarity)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    char *text_a, *text_b;
+    size_t text_a_len, text_b_len;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "ss", &text_a, &text_a_len, &text_b, &text_b_len)) {
+        return;
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("similarity", ft_obj, text_a_len + text_b_len, 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
+
+    fasttext::real score;
+    try {
+        score = fasttext->similarity(std::string(text_a, text_a_len), std::string(text_b, text_b_len));
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    RETURN_DOUBLE(score);
+}
+/* }}} */
+
+/* {{{ proto mixed fasttext::similarityMatrix(array a, array b[, array options])
+ */
+PHP_METHOD(fasttext, similarityMatrix)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    zval *texts_a, *texts_b, *options = NULL, *val;
+    bool parallel = false, packed = false;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "aa|a", &texts_a, &texts_b, &options)) {
+        return;
+    }
+
+    if (NULL != options) {
+        if (NULL != (val = zend_hash_str_find(Z_ARRVAL_P(options), "parallel", sizeof("parallel")-1))) {
+            parallel = zend_is_true(val);
+        }
+        if (NULL != (val = zend_hash_str_find(Z_ARRVAL_P(options), "packed", sizeof("packed")-1))) {
+            packed = zend_is_true(val);
+        }
+    }
+
+    std::vector<std::string> a, b;
+    php_fasttext_texts(Z_ARRVAL_P(texts_a), a);
+    php_fasttext_texts(Z_ARRVAL_P(texts_b), b);
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("similarityMatrix", ft_obj, a.size() * b.size(), 0);
+    CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+    if (!fasttext) {
+        RETURN_FALSE;
+    }
+
+    int64_t dim = fasttext->getDimension();
+    int64_t na = static_cast<int64_t>(a.size()), nb = static_cast<int64_t>(b.size());
+    std::vector<fasttext::real> rowsA, rowsB, transposed, scores(na * nb);
+    try {
+        php_fasttext_embed(fasttext, a, rowsA, parallel);
+        php_fasttext_embed(fasttext, b, rowsB, parallel);
+        croco::CSimilarity::normalize(rowsA.data(), na, dim);
+        croco::CSimilarity::normalize(rowsB.data(), nb, dim);
+        croco::CSimilarity::transpose(rowsB.data(), nb, dim, transposed);
+
+        php_fasttext_parallel_for(a.size(), parallel, [&rowsA, &transposed, &scores, nb, dim](size_t begin, size_t end) {
+            croco::CSimilarity::product(rowsA.data(), begin, end, transposed.data(), nb, dim, scores.data());
+        });
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    croco::CProbe result_probe(croco::CProbe::SCOPE_PHASE, "result", fasttext.get(), scores.size());
+    if (packed) {
+        RETURN_STRINGL(reinterpret_cast<const char*>(scores.data()), scores.size() * sizeof(fasttext::real));
+    }
+
+    array_init_size(return_value, static_cast<uint32_t>(na));
+    int64_t row = 0;
+    zend_ulong num_a, num_b;
+    zend_string *key_a, *key_b;
+    ZEND_HASH_FOREACH_KEY(Z_ARRVAL_P(texts_a), num_a, key_a) {
+        zval rowVal;
+        array_init_size(&rowVal, static_cast<uint32_t>(nb));
+
+        const fasttext::real *score = scores.data() + row * nb;
+        ZEND_HASH_FOREACH_KEY(Z_ARRVAL_P(texts_b), num_b, key_b) {
+            zval scoreVal;
+            ZVAL_DOUBLE(&scoreVal, *score++);
+            if (key_b) {
+                zend_hash_update(Z_ARRVAL(rowVal), key_b, &scoreVal);
+            } else {
+                zend_hash_index_update(Z_ARRVAL(rowVal), num_b, &scoreVal);
+            }
+        } ZEND_HASH_FOREACH_END();
+
+        if (key_a) {
+            zend_hash_update(Z_ARRVAL_P(return_value), key_a, &rowVal);
+        } else {
+            zend_hash_index_update(Z_ARRVAL_P(return_value), num_a, &rowVal);
+        }
+        row++;
+    } ZEND_HASH_FOREACH_END();
+}
+/* }}} */
+
+/* {{{ proto mixed fasttext::cluster(mixed input, int k[, array options])
+ */
+PHP_METHOD(fasttext, cluster)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    zval *input, *options = NULL, *val;
+    zend_long k;
+    bool parallel = false, normalize = false, packed = false;
+    croco::CKMeans::options_t params;
+    std::string save;
+    int64_t dim = 0;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "zl|a", &input, &k, &options)) {
+        return;
+    }
+    if (Z_TYPE_P(input) != IS_ARRAY && Z_TYPE_P(input) != IS_STRING) {
+        zend_type_error("input must be an array of texts or a packed matrix");
+        return;
+    }
+
+    if (NULL != options) {
+        HashTable *ht = Z_ARRVAL_P(options);
+        if (NULL != (val = zend_hash_str_find(ht, "iterations", sizeof("iterations")-1))) {
+            params.iterations = static_cast<int32_t>(MAX(1, zval_get_long(val)));
+        }
+        if (NULL != (val = zend_hash_str_find(ht, "batch", sizeof("batch")-1))) {
+            params.batch = static_cast<int64_t>(MAX(0, zval_get_long(val)));
+        }
+        if (NULL != (val = zend_hash_str_find(ht, "seed", sizeof("seed")-1))) {
+            params.seed = static_cast<uint64_t>(zval_get_long(val));
+        }
+        if (NULL != (val = zend_hash_str_find(ht, "dim", sizeof("dim")-1))) {
+            dim = static_cast<int64_t>(MAX(0, zval_get_long(val)));
+        }
+        if (NULL != (val = zend_hash_str_find(ht, "parallel", sizeof("parallel")-1))) {
+            parallel = zend_is_true(val);
+        }
+        if (NULL != (val = zend_hash_str_find(ht, "normalize", sizeof("normalize")-1))) {
+            normalize = zend_is_true(val);
+        }
+        if (NULL != (val = zend_hash_str_find(ht, "packed", sizeof("packed")-1))) {
+            packed = zend_is_true(val);
+        }
+        if (NULL != (val = zend_hash_str_find(ht, "save", sizeof("save")-1))) {
+            zend_string *str = zval_get_string(val);
+            save = std::string(ZSTR_VAL(str), ZSTR_LEN(str));
+            zend_string_release(str);
+        }
+    }
+    params.k = static_cast<int32_t>(MAX(0, MIN(k, INT32_MAX)));
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("cluster", ft_obj, Z_TYPE_P(input) == IS_ARRAY ? zend_hash_num_elements(Z_ARRVAL_P(input)) : Z_STRLEN_P(input), k);
+
+    std::vector<fasttext::real> rows;
+    int64_t n;
+    if (Z_TYPE_P(input) == IS_ARRAY || 0 == dim) {
+        CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+        if (!fasttext) {
+            RETURN_FALSE;
+        }
+        dim = fasttext->getDimension();
+
+        if (Z_TYPE_P(input) == IS_ARRAY) {
+            std::vector<std::string> texts;
+            php_fasttext_texts(Z_ARRVAL_P(input), texts);
+            try {
+                php_fasttext_embed(fasttext, texts, rows, parallel);
+            } catch (std::exception& e) {
+                ZVAL_STRING(&ft_obj->error, e.what());
+                RETURN_FALSE;
+            }
+        }
+    }
+    if (Z_TYPE_P(input) == IS_STRING) {
+        size_t bytes = dim * sizeof(fasttext::real);
+        if (0 == bytes || 0 != Z_STRLEN_P(input) % bytes) {
+            ZVAL_STRING(&ft_obj->error, "packed matrix length is not a multiple of the dimension");
+            RETURN_FALSE;
+        }
+        rows.resize(Z_STRLEN_P(input) / sizeof(fasttext::real));
+        memcpy(rows.data(), Z_STRVAL_P(input), Z_STRLEN_P(input));
+    }
+    n = static_cast<int64_t>(rows.size()) / dim;
+    if (normalize) {
+        croco::CSimilarity::normalize(rows.data(), n, dim);
+    }
+
+    croco::CKMeans kmeans(rows.data(), n, dim);
+    try {
+        size_t workers = parallel ? php_fasttext_get_pool().size() + 1 : 1;
+        kmeans.run(params, [parallel](size_t count, const croco::CKMeans::range_t& work) {
+            php_fasttext_parallel_for(count, parallel, work);
+        }, workers);
+
+        if (!save.empty()) {
+            kmeans.save(save);
+        }
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+    php_fasttext_set_clusters(ft_obj, kmeans.index());
+
+    croco::CProbe result_probe(croco::CProbe::SCOPE_PHASE, "result", NULL, n);
+    array_init(return_value);
+
+    zval assignVal;
+    const std::vector<int32_t> &labels = kmeans.assignments();
+    array_init_size(&assignVal, static_cast<uint32_t>(n));
+    if (Z_TYPE_P(input) == IS_ARRAY) {
+        size_t idx = 0;
+        zend_ulong num;
+        zend_string *key;
+        ZEND_HASH_FOREACH_KEY(Z_ARRVAL_P(input), num, key) {
+            zval labelVal;
+            ZVAL_LONG(&labelVal, labels[idx++]);
+            if (key) {
+                zend_hash_update(Z_ARRVAL(assignVal), key, &labelVal);
+            } else {
+                zend_hash_index_update(Z_ARRVAL(assignVal), num, &labelVal);
+            }
+        } ZEND_HASH_FOREACH_END();
+    } else {
+        for (int64_t idx = 0; idx < n; idx++) {
+            add_index_long(&assignVal, idx, labels[idx]);
+        }
+    }
+    zend_hash_str_add(Z_ARRVAL_P(return_value), "assignments", sizeof("assignments")-1, &assignVal);
+
+    zval centroidsVal;
+    const std::vector<fasttext::real> &centroids = kmeans.centroids();
+    if (packed) {
+        ZVAL_STRINGL(&centroidsVal, reinterpret_cast<const char*>(centroids.data()), centroids.size() * sizeof(fasttext::real));
+    } else {
+        array_init_size(&centroidsVal, static_cast<uint32_t>(params.k));
+        for (int32_t c = 0; c < params.k; c++) {
+            zval rowVal;
+            array_init_size(&rowVal, static_cast<uint32_t>(dim));
+            for (int64_t d = 0; d < dim; d++) {
+                add_index_double(&rowVal, d, centroids[c * dim + d]);
+            }
+            add_index_zval(&centroidsVal, c, &rowVal);
+        }
+    }
+    zend_hash_str_add(Z_ARRVAL_P(return_value), "centroids", sizeof("centroids")-1, &centroidsVal);
+
+    zval sizesVal;
+    array_init_size(&sizesVal, static_cast<uint32_t>(params.k));
+    for (int64_t size : kmeans.sizes()) {
+        add_next_index_long(&sizesVal, static_cast<zend_long>(size));
+    }
+    zend_hash_str_add(Z_ARRVAL_P(return_value), "sizes", sizeof("sizes")-1, &sizesVal);
+
+    add_assoc_double(return_value, "inertia", kmeans.inertia());
+    add_assoc_long(return_value, "iterations", kmeans.iterations());
+}
+/* }}} */
+
+/* {{{ proto bool fasttext::loadClusters(String filename)
+ */
+PHP_METHOD(fasttext, loadClusters)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    char *filename;
+    size_t filename_len;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "s", &filename, &filename_len)) {
+        return;
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("loadClusters", ft_obj, filename_len, 0);
+
+    try {
+        php_fasttext_set_clusters(ft_obj, croco::CClusterIndex::load(std::string(filename, filename_len)));
+    } catch (std::exception& e) {
+        ZVAL_STRING(&ft_obj->error, e.what());
+        RETURN_FALSE;
+    }
+
+    RETURN_TRUE;
+}
+/* }}} */
+
+/* {{{ proto mixed fasttext::nearestCluster(mixed input[, array options])
+ */
+PHP_METHOD(fasttext, nearestCluster)
+{
+    php_fasttext_object *ft_obj;
+    zval *object = getThis();
+    zval *input, *options = NULL, *val;
+    bool parallel = false, normalize = false;
+
+    if (FAILURE == zend_parse_parameters_throw(ZEND_NUM_ARGS(), "z|a", &input, &options)) {
+        return;
+    }
+    if (Z_TYPE_P(input) != IS_ARRAY && Z_TYPE_P(input) != IS_STRING) {
+        zend_type_error("input must be an array of texts or a packed matrix");
+        return;
+    }
+
+    if (NULL != options) {
+        HashTable *ht = Z_ARRVAL_P(options);
+        if (NULL != (val = zend_hash_str_find(ht, "parallel", sizeof("parallel")-1))) {
+            parallel = zend_is_true(val);
+        }
+        if (NULL != (val = zend_hash_str_find(ht, "normalize", sizeof("normalize")-1))) {
+            normalize = zend_is_true(val);
+        }
+    }
+
+    ft_obj = Z_FASTTEXT_P(object);
+    PHP_FASTTEXT_PROBE("nearestCluster", ft_obj, Z_TYPE_P(input) == IS_ARRAY ? zend_hash_num_elements(Z_ARRVAL_P(input)) : Z_STRLEN_P(input), 0);
+
+    const croco::CClusterIndex *clusters = static_cast<croco::CClusterIndex*>(ft_obj->clusters);
+    if (NULL == clusters) {
+        ZVAL_STRING(&ft_obj->error, "no clusters, run cluster() or loadClusters() first");
+        RETURN_FALSE;
+    }
+    int64_t dim = clusters->dim();
+
+    std::vector<fasttext::real> rows;
+    if (Z_TYPE_P(input) == IS_ARRAY) {
+        CFastTextPtr fasttext = php_fasttext_model(ft_obj);
+        if (!fasttext) {
+            RETURN_FALSE;
+        }
+        if (fasttext->getDimension() != dim) {
+            ZVAL_STRING(&ft_obj->error, "the dimension of the model does not match the clusters");
+            RETURN_FALSE;
+        }
+
+        std::vector<std::string> texts;
+        php_fasttext_texts(Z_ARRVAL_P(input), texts);
+        try {
+            php_fasttext_embed(fasttext, texts, rows, parallel);
+        } catch (std::exception& e) {
+            ZVAL_STRING(&ft_obj->error, e.what());
+            RETURN_FALSE;
+        }
+    } else {
+        size_t bytes = dim * sizeof(fasttext::real);
+        if (0 != Z_STRLEN_P(input) % bytes) {
+            ZVAL_STRING(&ft_obj->error, "packed matrix length is not a multiple of the dimension");
+            RETURN_FALSE;
+        }
+        rows.resize(Z_STRLEN_P(input) / sizeof(fasttext::real));
+        memcpy(rows.data(), Z_STRVAL_P(input), Z_STRLEN_P(input));
+    }
+    int64_t n = static_cast<int64_t>(rows.size()) / dim;
+    if (normalize) {
+        croco::CSimilarity::normalize(rows.data(), n, dim);
+    }
+
+    std::vector<fasttext::real> norms(n, 0.0), dists(n);
+    std::vector<int32_t> labels(n);
+    php_fasttext_parallel_for(static_cast<size_t>(n), parallel, [clusters, &rows, &norms, &labels, &dists, dim](size_t begin, size_t end) {
+        for (size_t idx = begin; idx < end; idx++) {
+            const fasttext::real *row = rows.data() + idx * dim;
+            for (int64_t d = 0; d < dim; d++) {
+                norms[idx] += row[d] * row[d];
+            }
+        }
+        clusters->assign(rows.data(), norms.data(), begin, end, labels.data() + begin, dists.data() + begin);
+    });
+
+    croco::CProbe result_probe(croco::CProbe::SCOPE_PHASE, "result", NULL, n);
+    array_init_size(return_value, static_cast<uint32_t>(n));
+
+    int64_t idx = 0;
+    auto nearest = [&labels, &dists, &idx](zval *entry) {
+        array_init_size(entry, 2);
+        add_assoc_long(entry, "cluster", labels[idx]);
+        add_assoc_double(entry, "distance", dists[idx]);
+        idx++;
+    };
+    if (Z_TYPE_P(input) == IS_ARRAY) {
+        zend_ulong num;
+        zend_string *key;
+        ZEND_HASH_FOREACH_KEY(Z_ARRVAL_P(input), num, key) {
+            zval entryVal;
+            nearest(&entryVal);
+            if (key) {
+                zend_hash_update(Z_ARRVAL_P(return_value), key, &entryVal);
+            } else {
+                zend_hash_index_update(Z_ARRVAL_P(return_value), num, &entryVal);
+            }
+        } ZEND_HASH_FOREACH_END();
+    } else {
+        while (idx < n) {
+            zval entryVal;
+            nearest(&entryVal);
+            add_next_index_zval(return_value, &entryVal);
+        }
+    }
+}
+/* }}} */
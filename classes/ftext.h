@@ -7,6 +7,10 @@
 #ifdef __cplusplus
 
 #include "cfasttext.h"
+#include "casync.h"
+#include "cmodelregistry.h"
+#include "ckmeans.h"
+#include "ctraincorpus.h"
 
 extern "C" {
 
@@ -25,6 +29,9 @@ typedef void *FastTextHandle;
 
 typedef struct _php_fasttext_object {
     FastTextHandle handle;
+    FastTextHandle async;
+    FastTextHandle clusters;
+    zend_bool lazy_results;
     zval error;
     zend_object zo;
 } php_fasttext_object;
@@ -52,6 +59,28 @@ PHP_METHOD(fasttext, getPredict);
 PHP_METHOD(fasttext, getNgrams);
 PHP_METHOD(fasttext, getNN);
 PHP_METHOD(fasttext, getAnalogies);
+PHP_METHOD(fasttext, getCacheStats);
+PHP_METHOD(fasttext, submitPredict);
+PHP_METHOD(fasttext, submitNN);
+PHP_METHOD(fasttext, poll);
+PHP_METHOD(fasttext, wait);
+PHP_METHOD(fasttext, getNotifyStream);
+PHP_METHOD(fasttext, train);
+PHP_METHOD(fasttext, save);
+PHP_METHOD(fasttext, predictMulti);
+PHP_METHOD(fasttext, analyze);
+PHP_METHOD(fasttext, getModelCacheStats);
+PHP_METHOD(fasttext, dropModel);
+PHP_METHOD(fasttext, setLazyResults);
+PHP_METHOD(fasttext, similarity);
+PHP_METHOD(fasttext, similarityMatrix);
+PHP_METHOD(fasttext, cluster);
+PHP_METHOD(fasttext, loadClusters);
+PHP_METHOD(fasttext, nearestCluster);
+
+extern zend_class_entry *php_fasttext_sc_entry;
+
+void php_fasttext_shutdown(void);
 
 #ifdef __cplusplus
 }   // extern "C"
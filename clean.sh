@@ -13,6 +13,7 @@ rm -rf \
     autom4te.cache \
     build \
     classes/.libs \
+    classes/fresult.lo \
     classes/ftext.lo \
     config.guess \
     config.h \
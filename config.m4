@@ -5,6 +5,9 @@ PHP_ARG_ENABLE(fasttext, whether to enable fasttext support,
 dnl Make sure that the comment is aligned:
 [  --enable-fasttext           Enable fasttext support])
 
+PHP_ARG_ENABLE(fasttext-probes, whether to enable fasttext USDT probes,
+[  --disable-fasttext-probes   Disable the USDT probes for perf/bpftrace], yes, no)
+
 if test "$PHP_FASTTEXT" != "no"; then
   PHP_REQUIRE_CXX()
 
@@ -42,5 +45,11 @@ if test "$PHP_FASTTEXT" != "no"; then
   CFLAGS="-O3 -funroll-loops"
   CXXFLAGS="-pthread -std=c++17 -funroll-loops -O3 -march=native"
 
-  PHP_NEW_EXTENSION(fasttext, classes/ftext.cc fasttext.c, $ext_shared,, -DZEND_ENABLE_STATIC_TSRMLS_CACHE=1)
+  # --enable-fasttext-probes -> USDT probes when systemtap-sdt headers exist
+  FASTTEXT_PROBE_FLAGS=""
+  if test "$PHP_FASTTEXT_PROBES" != "no"; then
+    AC_CHECK_HEADER([sys/sdt.h], [FASTTEXT_PROBE_FLAGS="-DHAVE_FASTTEXT_PROBES=1"])
+  fi
+
+  PHP_NEW_EXTENSION(fasttext, classes/ftext.cc classes/fresult.cc fasttext.c, $ext_shared,, -DZEND_ENABLE_STATIC_TSRMLS_CACHE=1 $FASTTEXT_PROBE_FLAGS)
 fi
@@ -13,6 +13,7 @@
 #include "SAPI.h"
 #include "php_fasttext.h"
 #include "classes/ftext.h"
+#include "classes/fresult.h"
 
 ZEND_DECLARE_MODULE_GLOBALS(fasttext)
 
@@ -20,14 +21,20 @@ ZEND_DECLARE_MODULE_GLOBALS(fasttext)
 */
 PHP_INI_BEGIN()
 	STD_PHP_INI_ENTRY("fasttext.model_dir",  NULL, PHP_INI_SYSTEM, OnUpdateString, model_dir, zend_fasttext_globals, fasttext_globals)
+	STD_PHP_INI_ENTRY("fasttext.oov_cache_size",  "1000", PHP_INI_ALL, OnUpdateLong, oov_cache_size, zend_fasttext_globals, fasttext_globals)
+	STD_PHP_INI_ENTRY("fasttext.threads",  "4", PHP_INI_SYSTEM, OnUpdateLong, threads, zend_fasttext_globals, fasttext_globals)
+	STD_PHP_INI_BOOLEAN("fasttext.share_models",  "0", PHP_INI_SYSTEM, OnUpdateBool, share_models, zend_fasttext_globals, fasttext_globals)
+	STD_PHP_INI_ENTRY("fasttext.cache_budget",  "0", PHP_INI_SYSTEM, OnUpdateLong, cache_budget, zend_fasttext_globals, fasttext_globals)
 PHP_INI_END()
 /* }}} */
 
 /* Handlers */
 static zend_object_handlers fasttext_object_handlers;
+static zend_object_handlers fasttext_result_object_handlers;
 
 /* Class entries */
 zend_class_entry *php_fasttext_sc_entry;
+zend_class_entry *php_fasttext_result_sc_entry;
 
 
 
@@ -37,6 +44,29 @@ ZEND_END_ARG_INFO()
 
 ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_load, 0, 0, 1)
 	ZEND_ARG_INFO(0, fileformat)
+	ZEND_ARG_ARRAY_INFO(0, options, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_predict_multi, 0, 0, 2)
+	ZEND_ARG_ARRAY_INFO(0, models, 0)
+	ZEND_ARG_INFO(0, text)
+	ZEND_ARG_INFO(0, k)
+	ZEND_ARG_INFO(0, parallel)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_analyze, 0, 0, 1)
+	ZEND_ARG_INFO(0, text)
+	ZEND_ARG_ARRAY_INFO(0, options, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_save, 0, 0, 1)
+	ZEND_ARG_INFO(0, filename)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_train, 0, 0, 2)
+	ZEND_ARG_ARRAY_INFO(0, args, 0)
+	ZEND_ARG_INFO(0, input)
+	ZEND_ARG_INFO(0, progress)
 ZEND_END_ARG_INFO()
 
 ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_word, 0, 0, 1)
@@ -51,6 +81,50 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_wordk, 0, 0, 1)
 	ZEND_ARG_INFO(0, word)
 	ZEND_ARG_INFO(0, k)
 ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_task, 0, 0, 1)
+	ZEND_ARG_INFO(0, task)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_wait, 0, 0, 1)
+	ZEND_ARG_INFO(0, task)
+	ZEND_ARG_INFO(0, timeout)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_similarity, 0, 0, 2)
+	ZEND_ARG_INFO(0, a)
+	ZEND_ARG_INFO(0, b)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_similarity_matrix, 0, 0, 2)
+	ZEND_ARG_ARRAY_INFO(0, a, 0)
+	ZEND_ARG_ARRAY_INFO(0, b, 0)
+	ZEND_ARG_ARRAY_INFO(0, options, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_cluster, 0, 0, 2)
+	ZEND_ARG_INFO(0, input)
+	ZEND_ARG_INFO(0, k)
+	ZEND_ARG_ARRAY_INFO(0, options, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_nearest_cluster, 0, 0, 1)
+	ZEND_ARG_INFO(0, input)
+	ZEND_ARG_ARRAY_INFO(0, options, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_lazy, 0, 0, 1)
+	ZEND_ARG_INFO(0, lazy)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_offset, 0, 0, 1)
+	ZEND_ARG_INFO(0, offset)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(arginfo_fasttext_offset_set, 0, 0, 2)
+	ZEND_ARG_INFO(0, offset)
+	ZEND_ARG_INFO(0, value)
+ZEND_END_ARG_INFO()
 /* }}} */
 
 
@@ -73,6 +147,41 @@ static zend_function_entry php_fasttext_class_methods[] = {
 	PHP_ME(fasttext, getNgrams,         arginfo_fasttext_word,  ZEND_ACC_PUBLIC)
 	PHP_ME(fasttext, getNN,             arginfo_fasttext_wordk, ZEND_ACC_PUBLIC)
 	PHP_ME(fasttext, getAnalogies,      arginfo_fasttext_wordk, ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, getCacheStats,     arginfo_fasttext_void,  ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, submitPredict,     arginfo_fasttext_wordk, ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, submitNN,          arginfo_fasttext_wordk, ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, poll,              arginfo_fasttext_task,  ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, wait,              arginfo_fasttext_wait,  ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, getNotifyStream,   arginfo_fasttext_void,  ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, train,             arginfo_fasttext_train, ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, save,              arginfo_fasttext_save,  ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, predictMulti,      arginfo_fasttext_predict_multi, ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+	PHP_ME(fasttext, analyze,           arginfo_fasttext_analyze, ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, getModelCacheStats,arginfo_fasttext_void,  ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+	PHP_ME(fasttext, dropModel,         arginfo_fasttext_save,  ZEND_ACC_PUBLIC|ZEND_ACC_STATIC)
+	PHP_ME(fasttext, setLazyResults,    arginfo_fasttext_lazy,  ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, similarity,        arginfo_fasttext_similarity, ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, similarityMatrix,  arginfo_fasttext_similarity_matrix, ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, cluster,           arginfo_fasttext_cluster, ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, loadClusters,      arginfo_fasttext_save,  ZEND_ACC_PUBLIC)
+	PHP_ME(fasttext, nearestCluster,    arginfo_fasttext_nearest_cluster, ZEND_ACC_PUBLIC)
+
+	PHP_FE_END
+};
+/* }}} */
+
+/* {{{ php_fasttext_result_class_methods */
+static zend_function_entry php_fasttext_result_class_methods[] = {
+	PHP_ME(fasttextresult, __construct, arginfo_fasttext_void,       ZEND_ACC_PRIVATE|ZEND_ACC_CTOR)
+	PHP_ME(fasttextresult, offsetExists,arginfo_fasttext_offset,     ZEND_ACC_PUBLIC)
+	PHP_ME(fasttextresult, offsetGet,   arginfo_fasttext_offset,     ZEND_ACC_PUBLIC)
+	PHP_ME(fasttextresult, offsetSet,   arginfo_fasttext_offset_set, ZEND_ACC_PUBLIC)
+	PHP_ME(fasttextresult, offsetUnset, arginfo_fasttext_offset,     ZEND_ACC_PUBLIC)
+	PHP_ME(fasttextresult, count,       arginfo_fasttext_void,       ZEND_ACC_PUBLIC)
+	PHP_ME(fasttextresult, getIterator, arginfo_fasttext_void,       ZEND_ACC_PUBLIC)
+	PHP_ME(fasttextresult, topLabel,    arginfo_fasttext_void,       ZEND_ACC_PUBLIC)
+	PHP_ME(fasttextresult, topScore,    arginfo_fasttext_void,       ZEND_ACC_PUBLIC)
+	PHP_ME(fasttextresult, toArray,     arginfo_fasttext_void,       ZEND_ACC_PUBLIC)
 
 	PHP_FE_END
 };
@@ -108,6 +217,37 @@ static zend_object *php_fasttext_object_new(zend_class_entry *class_type) /* {{{
 }
 /* }}} */
 
+static void php_fasttext_result_object_free_storage(zend_object *object) /* {{{ */
+{
+	php_fasttext_result_object *intern = php_fasttext_result_from_obj(object);
+
+	if (!intern) {
+		return;
+	}
+
+	php_fasttext_result_free(intern->handle);
+	intern->handle = NULL;
+
+	zend_object_std_dtor(&intern->zo);
+}
+/* }}} */
+
+static zend_object *php_fasttext_result_object_new(zend_class_entry *class_type) /* {{{ */
+{
+	php_fasttext_result_object *intern;
+
+	/* Allocate memory for it */
+	intern = ecalloc(1, sizeof(php_fasttext_result_object) + zend_object_properties_size(class_type));
+
+	zend_object_std_init(&intern->zo, class_type);
+	object_properties_init(&intern->zo, class_type);
+
+	intern->zo.handlers = &fasttext_result_object_handlers;
+
+	return &intern->zo;
+}
+/* }}} */
+
 
 /* {{{ PHP_MINIT_FUNCTION
 */
@@ -125,8 +265,26 @@ PHP_MINIT_FUNCTION(fasttext)
 	fasttext_object_handlers.free_obj = php_fasttext_object_free_storage;
 	php_fasttext_sc_entry = zend_register_internal_class(&ce);
 
+	memcpy(&fasttext_result_object_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+
+	/* Register fastTextResult Class */
+	INIT_CLASS_ENTRY(ce, "fastTextResult", php_fasttext_result_class_methods);
+	ce.create_object = php_fasttext_result_object_new;
+	fasttext_result_object_handlers.offset = XtOffsetOf(php_fasttext_result_object, zo);
+	fasttext_result_object_handlers.clone_obj = NULL;
+	fasttext_result_object_handlers.free_obj = php_fasttext_result_object_free_storage;
+	php_fasttext_result_sc_entry = zend_register_internal_class(&ce);
+	php_fasttext_result_sc_entry->ce_flags |= ZEND_ACC_FINAL;
+	php_fasttext_result_sc_entry->get_iterator = php_fasttext_result_get_iterator;
+	zend_class_implements(php_fasttext_result_sc_entry, 3, zend_ce_arrayaccess, zend_ce_countable, zend_ce_aggregate);
+
 	REGISTER_INI_ENTRIES();
 
+	/* only shared models are accounted, a private model belongs to its object */
+	if (0 < FASTTEXT_G(cache_budget) && !FASTTEXT_G(share_models)) {
+		php_error_docref(NULL, E_CORE_WARNING, "fasttext.cache_budget has no effect without fasttext.share_models");
+	}
+
 	return SUCCESS;
 }
 /* }}} */
@@ -135,6 +293,8 @@ PHP_MINIT_FUNCTION(fasttext)
 */
 PHP_MSHUTDOWN_FUNCTION(fasttext)
 {
+	php_fasttext_shutdown();
+
 	UNREGISTER_INI_ENTRIES();
 
 	return SUCCESS;
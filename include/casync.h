@@ -0,0 +1,286 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fasttext/real.h>
+
+#include "cworkerpool.h"
+
+namespace croco {
+
+/**
+ * CNotifyPipe
+ *
+ * self-pipe written once per finished task so that an event loop
+ * can select() on the read end
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CNotifyPipe {
+
+public:
+    CNotifyPipe();
+    ~CNotifyPipe();
+    void notify(void);
+    int fd(void) const;
+
+private:
+    int _fds[2];
+}; // class CNotifyPipe
+
+/**
+ * constructor
+ *
+ * @access public
+ */
+inline CNotifyPipe::CNotifyPipe()
+{
+    if (0 != pipe(_fds)) {
+        throw std::runtime_error("cannot create the notification pipe");
+    }
+    for (int idx = 0; idx < 2; idx++) {
+        fcntl(_fds[idx], F_SETFL, fcntl(_fds[idx], F_GETFL) | O_NONBLOCK);
+        fcntl(_fds[idx], F_SETFD, FD_CLOEXEC);
+    }
+}
+
+/**
+ * destructor
+ *
+ * @access public
+ */
+inline CNotifyPipe::~CNotifyPipe()
+{
+    close(_fds[0]);
+    close(_fds[1]);
+}
+
+/**
+ * notify
+ *
+ * a full pipe is already readable, so a failed write is not an error
+ *
+ * @access public
+ * @return void
+ */
+inline void CNotifyPipe::notify(void)
+{
+    const char byte = 1;
+    ssize_t written;
+    do {
+        written = write(_fds[1], &byte, 1);
+    } while (written < 0 && EINTR == errno);
+}
+
+/**
+ * fd
+ *
+ * @access public
+ * @return int  read end of the pipe
+ */
+inline int CNotifyPipe::fd(void) const
+{
+    return _fds[0];
+}
+
+/**
+ * CAsync
+ *
+ * tasks submitted by one fastText object onto the shared worker pool
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CAsync {
+
+public:
+    typedef std::vector<std::pair<fasttext::real, std::string>> result_t;
+    typedef std::function<result_t()> work_t;
+
+    enum kind_t {
+        KIND_PREDICT = 0,
+        KIND_NN
+    };
+
+    explicit CAsync(CWorkerPool& pool);
+    ~CAsync();
+    int64_t submit(kind_t kind, work_t work);
+    bool poll(int64_t id);
+    bool wait(int64_t id, double timeout, kind_t& kind, result_t& result);
+    int notifyFd(void) const;
+
+private:
+    struct task_t {
+        kind_t kind;
+        std::shared_future<result_t> future;
+    };
+
+    task_t& _find(int64_t id);
+
+    CWorkerPool& _pool;
+    std::shared_ptr<CNotifyPipe> _pipe;
+    std::mutex _mutex;
+    std::map<int64_t, task_t> _tasks;
+    int64_t _next;
+}; // class CAsync
+
+/**
+ * constructor
+ *
+ * @access public
+ * @param  CWorkerPool& pool
+ */
+inline CAsync::CAsync(CWorkerPool& pool)
+    : _pool(pool), _pipe(std::make_shared<CNotifyPipe>()), _next(1)
+{
+}
+
+/**
+ * destructor
+ *
+ * tasks in flight still reference the model, so wait for all of them
+ *
+ * @access public
+ */
+inline CAsync::~CAsync()
+{
+    for (auto &node : _tasks) {
+        node.second.future.wait();
+    }
+}
+
+/**
+ * submit
+ *
+ * @access public
+ * @param  kind_t kind
+ * @param  work_t work
+ * @return int64_t  task id
+ */
+inline int64_t CAsync::submit(kind_t kind, work_t work)
+{
+    auto promise = std::make_shared<std::promise<result_t>>();
+    std::shared_ptr<CNotifyPipe> pipe = _pipe;
+
+    int64_t id;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        id = _next++;
+        _tasks[id] = task_t{kind, promise->get_future().share()};
+    }
+
+    try {
+        _pool.submit([promise, pipe, work]() {
+            try {
+                promise->set_value(work());
+            } catch (...) {
+                promise->set_exception(std::current_exception());
+            }
+            pipe->notify();
+        });
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.erase(id);
+        throw;
+    }
+
+    return id;
+}
+
+/**
+ * poll
+ *
+ * @access public
+ * @param  int64_t id
+ * @return bool  true when the task has finished
+ */
+inline bool CAsync::poll(int64_t id)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    task_t &task = _find(id);
+
+    return std::future_status::ready ==
+        task.future.wait_for(std::chrono::seconds(0));
+}
+
+/**
+ * wait
+ *
+ * the task is forgotten once its result (or exception) has been taken
+ *
+ * @access public
+ * @param  int64_t id
+ * @param  double timeout  seconds, negative waits forever
+ * @param  kind_t& kind
+ * @param  result_t& result
+ * @return bool  false on timeout
+ */
+inline bool CAsync::wait(int64_t id, double timeout, kind_t& kind, result_t& result)
+{
+    std::shared_future<result_t> future;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        task_t &task = _find(id);
+        kind = task.kind;
+        future = task.future;
+    }
+
+    if (0 > timeout) {
+        future.wait();
+    } else if (std::future_status::ready !=
+            future.wait_for(std::chrono::duration<double>(timeout))) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.erase(id);
+    }
+    result = future.get();
+
+    return true;
+}
+
+/**
+ * notifyFd
+ *
+ * @access public
+ * @return int
+ */
+inline int CAsync::notifyFd(void) const
+{
+    return _pipe->fd();
+}
+
+/**
+ * find a task
+ *
+ * @access private
+ * @param  int64_t id
+ * @return task_t&
+ */
+inline CAsync::task_t& CAsync::_find(int64_t id)
+{
+    auto it = _tasks.find(id);
+    if (it == _tasks.end()) {
+        throw std::out_of_range("unknown task " + std::to_string(id));
+    }
+    return it->second;
+}
+
+} // namespace croco
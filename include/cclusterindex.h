@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fasttext/real.h>
+
+#include "csimilarity.h"
+
+namespace croco {
+
+/**
+ * CClusterIndex
+ *
+ * the centroids of a clustering, searchable for the nearest one of
+ * each row. it is written and read in the text format of fastText .vec
+ * files, the word of each row being its cluster number
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CClusterIndex {
+
+public:
+    static const int64_t BLOCK_ROWS = 256;
+
+    CClusterIndex();
+    CClusterIndex(const fasttext::real *centroids, int32_t k, int64_t dim);
+    static CClusterIndex load(const std::string& filename);
+    void save(const std::string& filename) const;
+    int32_t size(void) const;
+    int64_t dim(void) const;
+    const std::vector<fasttext::real>& centroids(void) const;
+    void assign(
+        const fasttext::real *rows,
+        const fasttext::real *norms,
+        int64_t begin,
+        int64_t end,
+        int32_t *labels,
+        fasttext::real *dists
+    ) const;
+
+private:
+    int32_t _k;
+    int64_t _dim;
+    std::vector<fasttext::real> _centroids;
+    std::vector<fasttext::real> _transposed;
+    std::vector<fasttext::real> _norms;
+}; // class CClusterIndex
+
+/**
+ * constructor of an empty index
+ *
+ * @access public
+ */
+inline CClusterIndex::CClusterIndex() : _k(0), _dim(0)
+{
+}
+
+/**
+ * constructor, the centroids are copied, transposed and their squared
+ * norms computed once
+ *
+ * @access public
+ * @param  const fasttext::real *centroids  k x dim
+ * @param  int32_t k
+ * @param  int64_t dim
+ */
+inline CClusterIndex::CClusterIndex(const fasttext::real *centroids, int32_t k, int64_t dim)
+    : _k(k), _dim(dim), _centroids(centroids, centroids + k * dim), _norms(k, 0.0)
+{
+    CSimilarity::transpose(_centroids.data(), _k, _dim, _transposed);
+    for (int32_t c = 0; c < _k; c++) {
+        const fasttext::real *centroid = _centroids.data() + c * _dim;
+        for (int64_t d = 0; d < _dim; d++) {
+            _norms[c] += centroid[d] * centroid[d];
+        }
+    }
+}
+
+/**
+ * read the centroids written by save()
+ *
+ * @access public
+ * @param  const std::string& filename
+ * @return CClusterIndex
+ */
+inline CClusterIndex CClusterIndex::load(const std::string& filename)
+{
+    std::ifstream ifs(filename);
+    if (!ifs.is_open()) {
+        throw std::invalid_argument(filename + " cannot be opened for loading!");
+    }
+
+    int64_t k, dim;
+    if (!(ifs >> k >> dim) || 0 >= k || 0 >= dim || INT32_MAX < k) {
+        throw std::invalid_argument(filename + " has wrong file format!");
+    }
+
+    std::vector<fasttext::real> centroids(k * dim, 0.0);
+    std::vector<bool> seen(k, false);
+    for (int64_t row = 0; row < k; row++) {
+        int64_t c;
+        if (!(ifs >> c) || 0 > c || k <= c || seen[c]) {
+            throw std::invalid_argument(filename + " has wrong file format!");
+        }
+        seen[c] = true;
+        for (int64_t d = 0; d < dim; d++) {
+            if (!(ifs >> centroids[c * dim + d])) {
+                throw std::invalid_argument(filename + " is truncated!");
+            }
+        }
+    }
+
+    return CClusterIndex(centroids.data(), static_cast<int32_t>(k), dim);
+}
+
+/**
+ * save in the .vec text format
+ *
+ * @access public
+ * @param  const std::string& filename
+ * @return void
+ */
+inline void CClusterIndex::save(const std::string& filename) const
+{
+    std::ofstream ofs(filename);
+    if (!ofs.is_open()) {
+        throw std::invalid_argument(filename + " cannot be opened for saving!");
+    }
+
+    /* enough digits to read back the same floats */
+    ofs.precision(9);
+    ofs << _k << " " << _dim << std::endl;
+    for (int32_t c = 0; c < _k; c++) {
+        ofs << c;
+        for (int64_t d = 0; d < _dim; d++) {
+            ofs << " " << _centroids[c * _dim + d];
+        }
+        ofs << std::endl;
+    }
+    if (!ofs) {
+        throw std::runtime_error(filename + " cannot be written!");
+    }
+}
+
+/**
+ * size
+ *
+ * @access public
+ * @return int32_t  number of clusters, 0 when empty
+ */
+inline int32_t CClusterIndex::size(void) const
+{
+    return _k;
+}
+
+/**
+ * dim
+ *
+ * @access public
+ * @return int64_t
+ */
+inline int64_t CClusterIndex::dim(void) const
+{
+    return _dim;
+}
+
+/**
+ * centroids
+ *
+ * @access public
+ * @return const std::vector<fasttext::real>&  k x dim
+ */
+inline const std::vector<fasttext::real>& CClusterIndex::centroids(void) const
+{
+    return _centroids;
+}
+
+/**
+ * nearest centroid of the rows [begin, end)
+ *
+ * disjoint row ranges can be assigned on different threads
+ *
+ * @access public
+ * @param  const fasttext::real *rows
+ * @param  const fasttext::real *norms  squared norms of rows
+ * @param  int64_t begin
+ * @param  int64_t end
+ * @param  int32_t *labels  end - begin entries
+ * @param  fasttext::real *dists  end - begin squared distances
+ * @return void
+ */
+inline void CClusterIndex::assign(
+    const fasttext::real *rows,
+    const fasttext::real *norms,
+    int64_t begin,
+    int64_t end,
+    int32_t *labels,
+    fasttext::real *dists
+) const
+{
+    std::vector<fasttext::real> scores(BLOCK_ROWS * _k);
+
+    for (int64_t i0 = begin; i0 < end; i0 += BLOCK_ROWS) {
+        const int64_t count = std::min(end, i0 + BLOCK_ROWS) - i0;
+        CSimilarity::product(rows + i0 * _dim, 0, count, _transposed.data(), _k, _dim, scores.data());
+
+        for (int64_t i = 0; i < count; i++) {
+            const fasttext::real *score = scores.data() + i * _k;
+            int32_t best = 0;
+            fasttext::real bestDist = _norms[0] - 2 * score[0];
+            for (int32_t c = 1; c < _k; c++) {
+                fasttext::real dist = _norms[c] - 2 * score[c];
+                if (dist < bestDist) {
+                    bestDist = dist;
+                    best = c;
+                }
+            }
+            labels[i0 - begin + i] = best;
+            dists[i0 - begin + i] = std::max<fasttext::real>(0.0, norms[i0 + i] + bestDist);
+        }
+    }
+}
+
+} // namespace croco
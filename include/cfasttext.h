@@ -1,13 +1,34 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <cmath>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <limits>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 #include <sstream>
 #include <vector>
 
+#include <stdio.h>
+#include <unistd.h>
+
 #include <fasttext/fasttext.h>
 
+#include "cheapmatrix.h"
+#include "clrucache.h"
+#include "cmappedmatrix.h"
+#include "cparallelreader.h"
+#include "cprobe.h"
+#include "csimilarity.h"
+
 namespace croco {
 
 /**
@@ -19,12 +40,93 @@ namespace croco {
 class CFastText : public fasttext::FastText {
     
 public:
+    typedef std::vector<std::pair<std::string, fasttext::Vector>> ngrams_t;
+    typedef std::pair<std::vector<int32_t>, std::vector<std::string>> subwords_t;
+
+    struct load_options_t {
+        bool lazy = false;
+        int advice = MADV_RANDOM;
+        std::vector<std::string> warmup;
+        int threads = 0;
+    };
+
     std::vector<std::pair<fasttext::real, std::string>> getPredict(int32_t k, std::string word);
+    void tokenize(std::string text, std::vector<int32_t>& words) const;
+    std::vector<std::pair<fasttext::real, std::string>> predictWords(int32_t k, const std::vector<int32_t>& words) const;
+    uint64_t getDictFingerprint(void) const;
+    size_t getFootprint(void) const;
+    void analyze(
+        const std::string& text,
+        int32_t k,
+        fasttext::Vector& embedding,
+        std::vector<std::pair<fasttext::real, std::string>>& predictions,
+        std::vector<std::pair<std::string, int32_t>>* tokens
+    );
+    void embed(const std::string& text, fasttext::real *row);
+    fasttext::real similarity(const std::string& a, const std::string& b);
     std::vector<std::pair<fasttext::real, std::string>> getAnalogies(int32_t k, std::string word);
+    std::vector<std::pair<fasttext::real, std::string>> getNN(const std::string& word, int32_t k);
+    void loadModel(const std::string& filename);
+    void loadModel(const std::string& filename, const load_options_t& options);
+    void advise(const load_options_t& options) const;
+    void saveModel(const std::string& filename);
+    void train(const fasttext::Args& args);
+    double getTrainProgress(void) const;
+    fasttext::real getTrainLoss(void) const;
+    static fasttext::Args makeArgs(const std::map<std::string, std::string>& params);
+    void getWordVector(fasttext::Vector& vec, const std::string& word) const;
+    ngrams_t getNgramVectors(const std::string& word) const;
     int32_t getK(void);
+    void prepareWordVectors(void);
+    void setCacheCapacity(size_t capacity);
+    CLruCache<fasttext::Vector>& getWordCache(void) const;
+    CLruCache<subwords_t>& getNgramCache(void) const;
+
+protected:
+    using fasttext::FastText::getNN;
 
 private:
+    /* shapes of model state kept per thread before they are all dropped */
+    static const size_t SCRATCH_SHAPES = 8;
+
+    /* per-thread buffers, the loaded parameters themselves are never written */
+    struct scratch_t {
+        std::unique_ptr<fasttext::Model::State> state;
+        std::vector<int32_t> words;
+        std::vector<int32_t> labels;
+        std::vector<std::pair<fasttext::real, int32_t>> predictions;
+    };
+
     std::vector<std::pair<int, std::string>> _parseQuery(std::string query);
+    scratch_t& _scratch(void) const;
+    void _predict(int32_t k, const std::vector<int32_t>& words, scratch_t& scratch) const;
+    void _predictSoftmax(int32_t k, const unaligned_real *wo, int64_t rows, int64_t cols, scratch_t& scratch) const;
+    std::shared_ptr<fasttext::Matrix> _mapMatrix(std::istream& in, std::shared_ptr<CMappedFile> file);
+    void _loadParallel(const std::string& filename, int threads);
+    static size_t _skipDictionary(const CMappedFile& file, size_t offset);
+    void _resetDerived(void);
+    static const unaligned_real *_denseData(const fasttext::Matrix& matrix);
+    const unaligned_real *_softmaxOutput(void) const;
+    void _analyzeSeparately(
+        const std::string& text,
+        int32_t k,
+        fasttext::Vector& embedding,
+        std::vector<std::pair<fasttext::real, std::string>>& predictions,
+        std::vector<std::pair<std::string, int32_t>>* tokens
+    );
+    void _addSubwords(std::vector<int32_t>& ids, const std::string& token, int32_t wid) const;
+    void _addWordNgrams(std::vector<int32_t>& ids, const std::vector<int32_t>& hashes, size_t from) const;
+    static fasttext::real _dot(const unaligned_real* a, const fasttext::real* b, int64_t n);
+    static size_t _vectorBytes(const fasttext::Vector& vec);
+    static size_t _subwordBytes(const subwords_t& subwords);
+
+    mutable CLruCache<fasttext::Vector> _wordCache{0, &CFastText::_vectorBytes};
+    mutable CLruCache<subwords_t> _ngramCache{0, &CFastText::_subwordBytes};
+    std::mutex _wordVectorsMutex;
+    std::atomic<bool> _wordVectorsReady{false};
+    std::atomic<int64_t> _trainTokens{0};
+    mutable std::atomic<uint64_t> _dictFingerprint{0};
+    mutable std::atomic<size_t> _dictBytes{0};
 }; // class CFastText
 
 /**
@@ -37,32 +139,434 @@ private:
  */
 inline std::vector<std::pair<fasttext::real, std::string>> CFastText::getPredict(int32_t k, std::string word)
 {
-    if ('\n' != word.back()) {
-        word.push_back('\n');
+    scratch_t &scratch = _scratch();
+    tokenize(word, scratch.words);
+
+    return predictWords(k, scratch.words);
+}
+
+/**
+ * tokenize
+ *
+ * @access public
+ * @param  std::string text
+ * @param  std::vector<int32_t>& words  word, subword and word n-gram ids
+ * @return void
+ */
+inline void CFastText::tokenize(std::string text, std::vector<int32_t>& words) const
+{
+    if (text.empty() || '\n' != text.back()) {
+        text.push_back('\n');
     }
+    CProbe probe(CProbe::SCOPE_PHASE, "tokenize", this, text.size());
     std::stringstream ioss;
-    ioss.str(word);
-
-    std::vector<int32_t> words, labels;
-    dict_->getLine(ioss, words, labels);
+    ioss.str(text);
 
-    std::vector<std::pair<fasttext::real, int32_t>> predictions;
-    fasttext::real threshold = 0.0;
-    predict(k, words, predictions, threshold);
+    scratch_t &scratch = _scratch();
+    words.clear();
+    scratch.labels.clear();
+    dict_->getLine(ioss, words, scratch.labels);
+}
 
+/**
+ * predictWords
+ *
+ * @access public
+ * @param  int32_t k
+ * @param  const std::vector<int32_t>& words  ids from tokenize() of a model with the same dictionary
+ * @return std::vector<std::pair<fasttext::real, std::string>>
+ */
+inline std::vector<std::pair<fasttext::real, std::string>> CFastText::predictWords(int32_t k, const std::vector<int32_t>& words) const
+{
     std::vector<std::pair<fasttext::real, std::string>> result;
-    for (const auto& p : predictions) {
+    if (words.empty()) {
+        return result;
+    }
+    if (args_->model != fasttext::model_name::sup) {
+        throw std::invalid_argument("Model needs to be supervised for prediction!");
+    }
+
+    CProbe probe(CProbe::SCOPE_PHASE, "predict", this, words.size(), k);
+    scratch_t &scratch = _scratch();
+    scratch.predictions.clear();
+    _predict(k, words, scratch);
+
+    for (const auto& p : scratch.predictions) {
         result.push_back(
             std::make_pair(
                 std::exp(p.first), 
                 dict_->getLabel(p.second)
             )
         );
-    } // for (const auto& p : predictions)
+    } // for (const auto& p : scratch.predictions)
 
     return result;
 }
 
+/**
+ * analyze
+ *
+ * a classifier reads the text once: the ids without EOS give the sentence
+ * vector of getSentenceVectors, the EOS row and the word n-grams ending
+ * in EOS are then added to the same sum for the hidden layer of the
+ * prediction. when the text has its own newline both see its EOS token
+ * and are the same vector
+ *
+ * @access public
+ * @param  const std::string& text
+ * @param  int32_t k  0 skips the prediction
+ * @param  fasttext::Vector& embedding
+ * @param  std::vector<std::pair<fasttext::real, std::string>>& predictions
+ * @param  std::vector<std::pair<std::string, int32_t>>* tokens  word => dictionary id (-1 when unknown), NULL to skip
+ * @return void
+ */
+inline void CFastText::analyze(
+    const std::string& text,
+    int32_t k,
+    fasttext::Vector& embedding,
+    std::vector<std::pair<fasttext::real, std::string>>& predictions,
+    std::vector<std::pair<std::string, int32_t>>* tokens
+)
+{
+    predictions.clear();
+    embedding.zero();
+    if (NULL != tokens) {
+        tokens->clear();
+    }
+
+    if (args_->model != fasttext::model_name::sup || dict_->isPruned()) {
+        _analyzeSeparately(text, k, embedding, predictions, tokens);
+        return;
+    }
+
+    scratch_t &scratch = _scratch();
+    std::vector<int32_t> &ids = scratch.words;
+    std::vector<int32_t> &hashes = scratch.labels;
+    ids.clear();
+    hashes.clear();
+
+    bool newline = false;
+    {
+        CProbe probe(CProbe::SCOPE_PHASE, "tokenize", this, text.size());
+        std::stringstream ioss(text);
+        std::string token;
+        while (dict_->readWord(ioss, token)) {
+            bool eos = (fasttext::Dictionary::EOS == token);
+            uint32_t h = dict_->hash(token);
+            int32_t wid = dict_->getId(token, h);
+            if (NULL != tokens && !eos) {
+                tokens->push_back(std::make_pair(token, wid));
+            }
+            if (newline) {
+                /* fastText stops at the first line, the token list does not */
+                continue;
+            }
+
+            fasttext::entry_type type = (0 > wid) ? dict_->getType(token) : dict_->getType(wid);
+            if (fasttext::entry_type::word == type) {
+                _addSubwords(ids, token, wid);
+                hashes.push_back(static_cast<int32_t>(h));
+            }
+            if (eos) {
+                newline = true;
+                if (NULL == tokens) {
+                    break;
+                }
+            }
+        }
+        _addWordNgrams(ids, hashes, 0);
+    }
+
+    /* the rows of the line in the order of Dictionary::getLine */
+    fasttext::Vector &hidden = scratch.state->hidden;
+    hidden.zero();
+    for (int32_t id : ids) {
+        input_->addRowToVector(hidden, id);
+    }
+
+    if (!newline) {
+        if (!ids.empty()) {
+            fasttext::real scale = 1.0 / ids.size();
+            for (int64_t idx = 0; idx < hidden.size(); idx++) {
+                embedding[idx] = hidden[idx] * scale;
+            }
+        }
+        if (0 >= k) {
+            return;
+        }
+
+        /* the EOS token tokenize() appends for the prediction */
+        size_t count = ids.size();
+        int32_t eos = dict_->getId(fasttext::Dictionary::EOS);
+        _addSubwords(ids, fasttext::Dictionary::EOS, eos);
+        hashes.push_back(static_cast<int32_t>(dict_->hash(fasttext::Dictionary::EOS)));
+        _addWordNgrams(ids, hashes, hashes.size() - 1);
+        for (size_t idx = count; idx < ids.size(); idx++) {
+            input_->addRowToVector(hidden, ids[idx]);
+        }
+    }
+    if (ids.empty()) {
+        return;
+    }
+    hidden.mul(1.0 / ids.size());
+
+    if (newline) {
+        std::copy(hidden.data(), hidden.data() + hidden.size(), embedding.data());
+        if (0 >= k) {
+            return;
+        }
+    }
+
+    CProbe probe(CProbe::SCOPE_PHASE, "predict", this, ids.size(), k);
+    scratch.predictions.clear();
+    const unaligned_real *wo = _softmaxOutput();
+    if (nullptr == wo) {
+        /* the other losses compute the hidden layer themselves */
+        fasttext::real threshold = 0.0;
+        model_->predict(ids, k, threshold, scratch.predictions, *scratch.state);
+    } else {
+        _predictSoftmax(k, wo, output_->size(0), output_->size(1), scratch);
+    }
+    for (const auto& p : scratch.predictions) {
+        predictions.push_back(std::make_pair(std::exp(p.first), dict_->getLabel(p.second)));
+    }
+}
+
+/**
+ * analyze() with a pass per result, for unsupervised models and for
+ * pruned dictionaries whose word n-gram ids cannot be computed here
+ *
+ * @access private
+ * @param  const std::string& text
+ * @param  int32_t k
+ * @param  fasttext::Vector& embedding
+ * @param  std::vector<std::pair<fasttext::real, std::string>>& predictions
+ * @param  std::vector<std::pair<std::string, int32_t>>* tokens
+ * @return void
+ */
+inline void CFastText::_analyzeSeparately(
+    const std::string& text,
+    int32_t k,
+    fasttext::Vector& embedding,
+    std::vector<std::pair<fasttext::real, std::string>>& predictions,
+    std::vector<std::pair<std::string, int32_t>>* tokens
+)
+{
+    if (NULL != tokens) {
+        std::stringstream ioss(text);
+        std::string token;
+        while (dict_->readWord(ioss, token)) {
+            if (fasttext::Dictionary::EOS != token) {
+                tokens->push_back(std::make_pair(token, dict_->getId(token)));
+            }
+        }
+    }
+
+    std::stringstream ioss(text);
+    getSentenceVector(ioss, embedding);
+    if (args_->model != fasttext::model_name::sup || 0 >= k) {
+        return;
+    }
+
+    scratch_t &scratch = _scratch();
+    tokenize(text, scratch.words);
+    if (scratch.words.empty()) {
+        return;
+    }
+
+    CProbe probe(CProbe::SCOPE_PHASE, "predict", this, scratch.words.size(), k);
+    scratch.predictions.clear();
+    _predict(k, scratch.words, scratch);
+    for (const auto& p : scratch.predictions) {
+        predictions.push_back(std::make_pair(std::exp(p.first), dict_->getLabel(p.second)));
+    }
+}
+
+/**
+ * append the input rows of a token, as Dictionary::addSubwords does
+ *
+ * @access private
+ * @param  std::vector<int32_t>& ids
+ * @param  const std::string& token
+ * @param  int32_t wid  dictionary id, -1 when unknown
+ * @return void
+ */
+inline void CFastText::_addSubwords(std::vector<int32_t>& ids, const std::string& token, int32_t wid) const
+{
+    if (0 <= wid) {
+        const std::vector<int32_t> &subwords = dict_->getSubwords(wid);
+        ids.insert(ids.end(), subwords.begin(), subwords.end());
+    } else if (fasttext::Dictionary::EOS != token) {
+        std::vector<int32_t> subwords = dict_->getSubwords(token);
+        ids.insert(ids.end(), subwords.begin(), subwords.end());
+    }
+}
+
+/**
+ * append the word n-gram rows ending at or after the word from, as
+ * Dictionary::addWordNgrams does for from = 0; the dictionary must not
+ * be pruned
+ *
+ * @access private
+ * @param  std::vector<int32_t>& ids
+ * @param  const std::vector<int32_t>& hashes  word hashes of the line
+ * @param  size_t from
+ * @return void
+ */
+inline void CFastText::_addWordNgrams(std::vector<int32_t>& ids, const std::vector<int32_t>& hashes, size_t from) const
+{
+    if (1 >= args_->wordNgrams || 0 >= args_->bucket) {
+        return;
+    }
+    size_t n = static_cast<size_t>(args_->wordNgrams);
+    size_t first = (from + 1 > n) ? from + 1 - n : 0;
+    for (size_t i = first; i < hashes.size(); i++) {
+        uint64_t h = hashes[i];
+        for (size_t j = i + 1; j < hashes.size() && j < i + n; j++) {
+            h = h * 116049371 + hashes[j];
+            if (j >= from) {
+                ids.push_back(dict_->nwords() + static_cast<int32_t>(h % args_->bucket));
+            }
+        }
+    }
+}
+
+/**
+ * getFootprint
+ *
+ * approximate heap size of the model: both matrices, the dictionary,
+ * the word vectors built for getNN and the out-of-vocabulary caches.
+ * mapped matrices count as 0, their pages belong to the page cache,
+ * are shared with other processes and stay there when the model is
+ * unloaded
+ *
+ * @access public
+ * @return size_t  bytes
+ */
+inline size_t CFastText::getFootprint(void) const
+{
+    if (!dict_) {
+        return 0;
+    }
+
+    size_t dictBytes = _dictBytes.load();
+    if (0 == dictBytes) {
+        /* word2int_ is always MAX_VOCAB_SIZE (30M) slots */
+        dictBytes = 30000000 * sizeof(int32_t);
+        for (int32_t id = 0; id < dict_->nwords(); id++) {
+            dictBytes += 64 + dict_->getWord(id).size();
+            dictBytes += dict_->getSubwords(id).size() * sizeof(int32_t);
+        }
+        for (int32_t id = 0; id < dict_->nlabels(); id++) {
+            dictBytes += 64 + dict_->getLabel(id).size();
+        }
+        _dictBytes.store(dictBytes);
+    }
+
+    auto matrixBytes = [this](const std::shared_ptr<fasttext::Matrix>& matrix) -> size_t {
+        if (!matrix || nullptr != dynamic_cast<const CMappedMatrix*>(matrix.get())) {
+            return 0;
+        }
+        size_t cells = static_cast<size_t>(matrix->size(0) * matrix->size(1));
+        if (nullptr == _denseData(*matrix)) {
+            /* product quantized: about one byte per sub-vector */
+            return cells / std::max<size_t>(1, args_->dsub);
+        }
+        return cells * sizeof(fasttext::real);
+    };
+
+    size_t bytes = dictBytes + matrixBytes(input_) + matrixBytes(output_);
+    if (_wordVectorsReady.load()) {
+        bytes += static_cast<size_t>(dict_->nwords()) * args_->dim * sizeof(fasttext::real);
+    }
+    bytes += _wordCache.bytes() + _ngramCache.bytes();
+
+    return bytes;
+}
+
+/**
+ * getDictFingerprint
+ *
+ * two models with the same fingerprint turn any text into the same ids
+ * (same word list and n-gram settings, labels may differ)
+ *
+ * @access public
+ * @return uint64_t
+ */
+inline uint64_t CFastText::getDictFingerprint(void) const
+{
+    uint64_t hash = _dictFingerprint.load();
+    if (0 != hash) {
+        return hash;
+    }
+
+    hash = 14695981039346656037ULL;
+    auto mix = [&hash](const void *data, size_t len) {
+        const unsigned char *ptr = static_cast<const unsigned char*>(data);
+        for (size_t idx = 0; idx < len; idx++) {
+            hash ^= ptr[idx];
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    int32_t params[] = {
+        dict_->nwords(), args_->bucket, args_->minn, args_->maxn, args_->wordNgrams
+    };
+    mix(params, sizeof(params));
+    mix(args_->label.data(), args_->label.size());
+    if (dict_->isPruned()) {
+        /* pruned n-gram ids are remapped per model */
+        const void *self = this;
+        mix(&self, sizeof(self));
+    }
+    for (int32_t id = 0; id < dict_->nwords(); id++) {
+        std::string word = dict_->getWord(id);
+        mix(word.data(), word.size() + 1);
+    }
+
+    if (0 == hash) {
+        hash = 1;
+    }
+    _dictFingerprint.store(hash);
+    return hash;
+}
+
+/**
+ * embed
+ *
+ * the sentence vector of getSentenceVectors, written to a plain row
+ *
+ * @access public
+ * @param  const std::string& text
+ * @param  fasttext::real *row  getDimension() values
+ * @return void
+ */
+inline void CFastText::embed(const std::string& text, fasttext::real *row)
+{
+    fasttext::Vector vec(args_->dim);
+    std::stringstream ioss(text);
+    getSentenceVector(ioss, vec);
+
+    std::copy(vec.data(), vec.data() + vec.size(), row);
+}
+
+/**
+ * similarity
+ *
+ * @access public
+ * @param  const std::string& a
+ * @param  const std::string& b
+ * @return fasttext::real  cosine of both sentence vectors
+ */
+inline fasttext::real CFastText::similarity(const std::string& a, const std::string& b)
+{
+    std::vector<fasttext::real> rows(2 * args_->dim);
+    embed(a, rows.data());
+    embed(b, rows.data() + args_->dim);
+
+    return CSimilarity::cosine(rows.data(), rows.data() + args_->dim, args_->dim);
+}
+
 /**
  * getAnalogies
  *
@@ -85,13 +589,435 @@ inline std::vector<std::pair<fasttext::real, std::string>> CFastText::getAnalogi
         banSet.insert(node.second);
     }
 
-    lazyComputeWordVectors();
+    prepareWordVectors();
     assert(wordVectors_);
 
-    std::vector<std::pair<fasttext::real, std::string>> result;
+    CProbe probe(CProbe::SCOPE_PHASE, "nn", this, word.size(), k);
     return getNN(*wordVectors_, query, k, banSet);
 }
 
+/**
+ * getNN
+ *
+ * @access public
+ * @param  const std::string& word
+ * @param  int32_t k
+ * @return std::vector<std::pair<fasttext::real, std::string>>
+ */
+inline std::vector<std::pair<fasttext::real, std::string>> CFastText::getNN(const std::string& word, int32_t k)
+{
+    fasttext::Vector query(args_->dim);
+    getWordVector(query, word);
+
+    prepareWordVectors();
+    assert(wordVectors_);
+
+    CProbe probe(CProbe::SCOPE_PHASE, "nn", this, word.size(), k);
+    return getNN(*wordVectors_, query, k, {word});
+}
+
+/**
+ * loadModel
+ *
+ * @access public
+ * @param  const std::string& filename
+ * @return void
+ */
+inline void CFastText::loadModel(const std::string& filename)
+{
+    CProbe probe(CProbe::SCOPE_PHASE, "load", this, filename.size());
+    fasttext::FastText::loadModel(filename);
+    _resetDerived();
+}
+
+/**
+ * loadModel
+ *
+ * with options.lazy the dictionary is read up front while both
+ * matrices are mapped from the file, so their rows are only paged in
+ * when a lookup touches them. otherwise options.threads above 1 reads
+ * the matrices on that many threads while the dictionary is built
+ *
+ * @access public
+ * @param  const std::string& filename
+ * @param  const load_options_t& options
+ * @return void
+ */
+inline void CFastText::loadModel(const std::string& filename, const load_options_t& options)
+{
+    if (!options.lazy) {
+        if (1 < options.threads) {
+            _loadParallel(filename, options.threads);
+        } else {
+            loadModel(filename);
+        }
+        return;
+    }
+
+    CProbe probe(CProbe::SCOPE_PHASE, "load_lazy", this, filename.size());
+    std::ifstream ifs(filename, std::ifstream::binary);
+    if (!ifs.is_open()) {
+        throw std::invalid_argument(filename + " cannot be opened for loading!");
+    }
+    if (!checkModel(ifs)) {
+        throw std::invalid_argument(filename + " has wrong file format!");
+    }
+
+    args_ = std::make_shared<fasttext::Args>();
+    args_->load(ifs);
+    if (version == 11 && args_->model == fasttext::model_name::sup) {
+        // backward compatibility: old supervised models do not use char ngrams.
+        args_->maxn = 0;
+    }
+    dict_ = std::make_shared<fasttext::Dictionary>(args_, ifs);
+
+    bool quantInput;
+    ifs.read((char*)&quantInput, sizeof(bool));
+    if (quantInput) {
+        /* quantized models are small, nothing to gain from mapping them */
+        ifs.close();
+        loadModel(filename);
+        return;
+    }
+    if (dict_->isPruned()) {
+        throw std::invalid_argument("Invalid model file.");
+    }
+
+    auto file = std::make_shared<CMappedFile>(filename);
+    quant_ = false;
+    input_ = _mapMatrix(ifs, file);
+    ifs.read((char*)&args_->qout, sizeof(bool));
+    output_ = _mapMatrix(ifs, file);
+    if (!ifs) {
+        throw std::invalid_argument(filename + " is truncated!");
+    }
+    buildModel();
+    _resetDerived();
+    advise(options);
+}
+
+/**
+ * apply the madvise() hints and warm-up words of load options to the
+ * mapped matrices, nothing to do for a model read into memory
+ *
+ * @access public
+ * @param  const load_options_t& options
+ * @return void
+ */
+inline void CFastText::advise(const load_options_t& options) const
+{
+    auto input = std::dynamic_pointer_cast<CMappedMatrix>(input_);
+    if (input) {
+        input->advise(options.advice);
+        for (const auto& word : options.warmup) {
+            for (int32_t id : dict_->getSubwords(word)) {
+                input->advise(id, MADV_WILLNEED);
+            }
+        }
+    }
+
+    /* every prediction scans the whole output matrix of a classifier */
+    auto output = std::dynamic_pointer_cast<CMappedMatrix>(output_);
+    if (output) {
+        output->advise(args_->model == fasttext::model_name::sup ? MADV_WILLNEED : options.advice);
+    }
+}
+
+/**
+ * saveModel
+ *
+ * the model is written next to the target and renamed over it, so a
+ * process which has the old file mapped (lazy load) keeps reading the
+ * old inode instead of a truncated file
+ *
+ * @access public
+ * @param  const std::string& filename
+ * @return void
+ */
+inline void CFastText::saveModel(const std::string& filename)
+{
+    static std::atomic<uint64_t> counter{0};
+    std::string tmp = filename + ".tmp." + std::to_string(getpid()) + "." + std::to_string(++counter);
+
+    try {
+        fasttext::FastText::saveModel(tmp);
+    } catch (...) {
+        unlink(tmp.c_str());
+        throw;
+    }
+    if (0 != rename(tmp.c_str(), filename.c_str())) {
+        unlink(tmp.c_str());
+        throw std::invalid_argument(filename + " cannot be opened for saving!");
+    }
+}
+
+/**
+ * train
+ *
+ * same steps as fasttext::FastText::train, the token total is published
+ * before the training threads start so that another thread can report
+ * the progress
+ *
+ * @access public
+ * @param  const fasttext::Args& args
+ * @return void
+ */
+inline void CFastText::train(const fasttext::Args& args)
+{
+    CProbe probe(CProbe::SCOPE_PHASE, "train", this, args.input.size());
+    _trainTokens.store(0);
+
+    args_ = std::make_shared<fasttext::Args>(args);
+    dict_ = std::make_shared<fasttext::Dictionary>(args_);
+    if (args_->input == "-") {
+        throw std::invalid_argument("Cannot use stdin for training!");
+    }
+    std::ifstream ifs(args_->input);
+    if (!ifs.is_open()) {
+        throw std::invalid_argument(args_->input + " cannot be opened for training!");
+    }
+    dict_->readFromFile(ifs);
+    ifs.close();
+
+    if (0 != args_->pretrainedVectors.size()) {
+        input_ = getInputMatrixFromFile(args_->pretrainedVectors);
+    } else {
+        input_ = createRandomMatrix();
+    }
+    output_ = createTrainOutputMatrix();
+    quant_ = false;
+    auto loss = createLoss(output_);
+    bool normalizeGradient = (args_->model == fasttext::model_name::sup);
+    model_ = std::make_shared<fasttext::Model>(input_, output_, loss, normalizeGradient);
+
+    _trainTokens.store(args_->epoch * dict_->ntokens());
+    startThreads();
+    _resetDerived();
+}
+
+/**
+ * getTrainProgress
+ *
+ * @access public
+ * @return double  0.0 - 1.0
+ */
+inline double CFastText::getTrainProgress(void) const
+{
+    int64_t total = _trainTokens.load();
+    if (0 >= total) {
+        return 0.0;
+    }
+    return std::min(1.0, static_cast<double>(tokenCount_.load()) / total);
+}
+
+/**
+ * getTrainLoss
+ *
+ * @access public
+ * @return fasttext::real  negative until the first update
+ */
+inline fasttext::real CFastText::getTrainLoss(void) const
+{
+    return loss_.load();
+}
+
+/**
+ * build training arguments from fastText command line option names
+ *
+ * @access public
+ * @param  const std::map<std::string, std::string>& params  option name (without dash) => value
+ * @return fasttext::Args
+ */
+inline fasttext::Args CFastText::makeArgs(const std::map<std::string, std::string>& params)
+{
+    fasttext::Args args;
+    args.verbose = 0;
+
+    auto model = params.find("model");
+    std::string command = (model == params.end()) ? "supervised" : model->second;
+    if ("supervised" == command) {
+        args.model = fasttext::model_name::sup;
+        args.loss = fasttext::loss_name::softmax;
+        args.minCount = 1;
+        args.minn = 0;
+        args.maxn = 0;
+        args.lr = 0.1;
+    } else if ("cbow" == command) {
+        args.model = fasttext::model_name::cbow;
+    } else if ("skipgram" == command) {
+        args.model = fasttext::model_name::sg;
+    } else {
+        throw std::invalid_argument("unknown model: " + command);
+    }
+
+    for (const auto& param : params) {
+        const std::string& key = param.first;
+        const std::string& val = param.second;
+
+        auto toInt = [&key, &val]() {
+            try {
+                return std::stoi(val);
+            } catch (std::logic_error&) {
+                throw std::invalid_argument("invalid value for " + key + ": " + val);
+            }
+        };
+        auto toReal = [&key, &val]() {
+            try {
+                return std::stod(val);
+            } catch (std::logic_error&) {
+                throw std::invalid_argument("invalid value for " + key + ": " + val);
+            }
+        };
+
+        if ("model" == key) {
+            continue;
+        } else if ("lr" == key) {
+            args.lr = toReal();
+        } else if ("lrUpdateRate" == key) {
+            args.lrUpdateRate = toInt();
+        } else if ("dim" == key) {
+            args.dim = toInt();
+        } else if ("ws" == key) {
+            args.ws = toInt();
+        } else if ("epoch" == key) {
+            args.epoch = toInt();
+        } else if ("minCount" == key) {
+            args.minCount = toInt();
+        } else if ("minCountLabel" == key) {
+            args.minCountLabel = toInt();
+        } else if ("neg" == key) {
+            args.neg = toInt();
+        } else if ("wordNgrams" == key) {
+            args.wordNgrams = toInt();
+        } else if ("loss" == key) {
+            if ("hs" == val) {
+                args.loss = fasttext::loss_name::hs;
+            } else if ("ns" == val) {
+                args.loss = fasttext::loss_name::ns;
+            } else if ("softmax" == val) {
+                args.loss = fasttext::loss_name::softmax;
+            } else if ("ova" == val || "one-vs-all" == val) {
+                args.loss = fasttext::loss_name::ova;
+            } else {
+                throw std::invalid_argument("unknown loss: " + val);
+            }
+        } else if ("bucket" == key) {
+            args.bucket = toInt();
+        } else if ("minn" == key) {
+            args.minn = toInt();
+        } else if ("maxn" == key) {
+            args.maxn = toInt();
+        } else if ("thread" == key) {
+            args.thread = toInt();
+        } else if ("t" == key) {
+            args.t = toReal();
+        } else if ("label" == key) {
+            args.label = val;
+        } else if ("verbose" == key) {
+            args.verbose = toInt();
+        } else if ("pretrainedVectors" == key) {
+            args.pretrainedVectors = val;
+        } else {
+            throw std::invalid_argument("unknown argument: " + key);
+        }
+    }
+
+    /* values fastText would crash, exit() or wait forever on */
+    auto require = [](bool valid, const char *key, const char *rule) {
+        if (!valid) {
+            throw std::invalid_argument(std::string("invalid value for ") + key + ": " + rule);
+        }
+    };
+    require(0.0 < args.lr, "lr", "needs to be greater than 0");
+    require(1 <= args.lrUpdateRate, "lrUpdateRate", "needs to be 1 or higher");
+    require(1 <= args.dim, "dim", "needs to be 1 or higher");
+    require(1 <= args.ws, "ws", "needs to be 1 or higher");
+    require(1 <= args.epoch, "epoch", "needs to be 1 or higher");
+    require(0 <= args.minCount, "minCount", "needs to be 0 or higher");
+    require(0 <= args.minCountLabel, "minCountLabel", "needs to be 0 or higher");
+    require(1 <= args.neg, "neg", "needs to be 1 or higher");
+    require(1 <= args.wordNgrams, "wordNgrams", "needs to be 1 or higher");
+    require(0 <= args.bucket, "bucket", "needs to be 0 or higher");
+    require(0 <= args.minn, "minn", "needs to be 0 or higher");
+    require(0 <= args.maxn, "maxn", "needs to be 0 or higher");
+    require(0 == args.maxn || args.minn <= args.maxn, "minn", "needs to be maxn or lower");
+    require(1 <= args.thread, "thread", "needs to be 1 or higher");
+    require(0.0 < args.t, "t", "needs to be greater than 0");
+    require(!args.label.empty(), "label", "needs a prefix");
+    require(0 <= args.verbose, "verbose", "needs to be 0 or higher");
+    if (1 < args.wordNgrams || 0 < args.maxn) {
+        require(0 < args.bucket, "bucket", "needs to be 1 or higher with wordNgrams or maxn");
+    }
+
+    if (args.wordNgrams <= 1 && args.maxn == 0) {
+        args.bucket = 0;
+    }
+
+    return args;
+}
+
+/**
+ * getWordVector
+ *
+ * out-of-vocabulary words are served from the LRU cache
+ * instead of hashing every character n-gram again
+ *
+ * @access public
+ * @param  fasttext::Vector& vec
+ * @param  const std::string& word
+ * @return void
+ */
+inline void CFastText::getWordVector(fasttext::Vector& vec, const std::string& word) const
+{
+    if (0 <= dict_->getId(word)) {
+        fasttext::FastText::getWordVector(vec, word);
+        return;
+    }
+
+    if (_wordCache.get(word, vec)) {
+        return;
+    }
+    fasttext::FastText::getWordVector(vec, word);
+    _wordCache.put(word, vec);
+}
+
+/**
+ * getNgramVectors
+ *
+ * the cache keeps the n-gram ids and strings of out-of-vocabulary
+ * words, a few hundred bytes each, and the rows are copied again on
+ * every call
+ *
+ * @access public
+ * @param  const std::string& word
+ * @return ngrams_t
+ */
+inline CFastText::ngrams_t CFastText::getNgramVectors(const std::string& word) const
+{
+    if (0 <= dict_->getId(word)) {
+        return fasttext::FastText::getNgramVectors(word);
+    }
+
+    subwords_t subwords;
+    if (!_ngramCache.get(word, subwords)) {
+        dict_->getSubwords(word, subwords.first, subwords.second);
+        _ngramCache.put(word, subwords);
+    }
+
+    ngrams_t result;
+    result.reserve(subwords.first.size());
+    for (size_t idx = 0; idx < subwords.first.size(); idx++) {
+        fasttext::Vector vec(args_->dim);
+        vec.zero();
+        if (0 <= subwords.first[idx]) {
+            vec.addRow(*input_, subwords.first[idx]);
+        }
+        result.push_back(std::make_pair(subwords.second[idx], std::move(vec)));
+    }
+
+    return result;
+}
+
 /**
  * getK
  *
@@ -107,6 +1033,452 @@ inline int32_t CFastText::getK(void)
     return static_cast<int32_t>(x + 0.5f);
 }
 
+/**
+ * prepareWordVectors
+ *
+ * build the word vector matrix once, whichever thread gets here first
+ *
+ * @access public
+ * @return void
+ */
+inline void CFastText::prepareWordVectors(void)
+{
+    if (_wordVectorsReady.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_wordVectorsMutex);
+    if (!_wordVectorsReady.load(std::memory_order_relaxed)) {
+        CProbe probe(CProbe::SCOPE_PHASE, "word_vectors", this, dict_->nwords());
+        lazyComputeWordVectors();
+        _wordVectorsReady.store(true, std::memory_order_release);
+    }
+}
+
+/**
+ * setCacheCapacity
+ *
+ * @access public
+ * @param  size_t capacity  number of out-of-vocabulary words kept, 0 disables the cache
+ * @return void
+ */
+inline void CFastText::setCacheCapacity(size_t capacity)
+{
+    _wordCache.setCapacity(capacity);
+    _ngramCache.setCapacity(capacity);
+}
+
+/**
+ * getWordCache
+ *
+ * @access public
+ * @return CLruCache<fasttext::Vector>&
+ */
+inline CLruCache<fasttext::Vector>& CFastText::getWordCache(void) const
+{
+    return _wordCache;
+}
+
+/**
+ * getNgramCache
+ *
+ * @access public
+ * @return CLruCache<CFastText::subwords_t>&
+ */
+inline CLruCache<CFastText::subwords_t>& CFastText::getNgramCache(void) const
+{
+    return _ngramCache;
+}
+
+/**
+ * heap bytes of a cached word vector
+ *
+ * @access private
+ * @param  const fasttext::Vector& vec
+ * @return size_t
+ */
+inline size_t CFastText::_vectorBytes(const fasttext::Vector& vec)
+{
+    return sizeof(vec) + static_cast<size_t>(vec.size()) * sizeof(fasttext::real);
+}
+
+/**
+ * heap bytes of cached n-gram ids and strings
+ *
+ * @access private
+ * @param  const subwords_t& subwords
+ * @return size_t
+ */
+inline size_t CFastText::_subwordBytes(const subwords_t& subwords)
+{
+    size_t bytes = sizeof(subwords) + subwords.first.size() * sizeof(int32_t);
+    for (const auto &substring : subwords.second) {
+        bytes += sizeof(substring) + substring.size();
+    }
+    return bytes;
+}
+
+/**
+ * per-thread scratch state sized for this model
+ *
+ * one scratch per (dim, output size), so a thread which alternates
+ * between models (predictMulti, several tenants) does not reallocate
+ * the state on every call
+ *
+ * @access private
+ * @return scratch_t&
+ */
+inline CFastText::scratch_t& CFastText::_scratch(void) const
+{
+    thread_local std::map<std::pair<int64_t, int64_t>, scratch_t> scratches;
+
+    std::pair<int64_t, int64_t> shape(args_->dim, output_->size(0));
+    auto it = scratches.find(shape);
+    if (it == scratches.end()) {
+        if (SCRATCH_SHAPES <= scratches.size()) {
+            scratches.clear();
+        }
+        it = scratches.emplace(shape, scratch_t()).first;
+        it->second.state.reset(new fasttext::Model::State(shape.first, shape.second, 0));
+    }
+
+    return it->second;
+}
+
+/**
+ * forward pass into scratch.predictions (log-probabilities)
+ *
+ * @access private
+ * @param  int32_t k
+ * @param  const std::vector<int32_t>& words
+ * @param  scratch_t& scratch
+ * @return void
+ */
+inline void CFastText::_predict(int32_t k, const std::vector<int32_t>& words, scratch_t& scratch) const
+{
+    if (0 >= k) {
+        throw std::invalid_argument("k needs to be 1 or higher!");
+    }
+
+    const unaligned_real *wo = _softmaxOutput();
+    if (nullptr == wo) {
+        fasttext::real threshold = 0.0;
+        model_->predict(words, k, threshold, scratch.predictions, *scratch.state);
+        return;
+    }
+
+    model_->computeHidden(words, *scratch.state);
+    _predictSoftmax(k, wo, output_->size(0), output_->size(1), scratch);
+}
+
+/**
+ * flat softmax restricted to the k best labels
+ *
+ * the logits are written into the scratch output vector while the
+ * maximum is tracked, the second pass accumulates the normaliser and
+ * keeps a k sized min-heap of raw logits, so only the winners are
+ * turned into log-probabilities
+ *
+ * @access private
+ * @param  int32_t k
+ * @param  const unaligned_real *wo  row-major output matrix
+ * @param  int64_t rows
+ * @param  int64_t cols
+ * @param  scratch_t& scratch
+ * @return void
+ */
+inline void CFastText::_predictSoftmax(int32_t k, const unaligned_real *wo, int64_t rows, int64_t cols, scratch_t& scratch) const
+{
+    const fasttext::real *hidden = scratch.state->hidden.data();
+    fasttext::real *logits = scratch.state->output.data();
+    const unaligned_real *row = wo;
+
+    fasttext::real max = -std::numeric_limits<fasttext::real>::infinity();
+    for (int64_t idx = 0; idx < rows; idx++, row += cols) {
+        logits[idx] = _dot(row, hidden, cols);
+        max = std::max(max, logits[idx]);
+    }
+
+    auto comparePairs = [](const std::pair<fasttext::real, int32_t>& l,
+                           const std::pair<fasttext::real, int32_t>& r) {
+        return l.first > r.first;
+    };
+
+    std::vector<std::pair<fasttext::real, int32_t>> &heap = scratch.predictions;
+    size_t topk = static_cast<size_t>(std::min<int64_t>(k, rows));
+    heap.reserve(topk + 1);
+
+    fasttext::real sum = 0.0;
+    for (int64_t idx = 0; idx < rows; idx++) {
+        fasttext::real logit = logits[idx];
+        sum += std::exp(logit - max);
+
+        if (heap.size() == topk && logit < heap.front().first) {
+            continue;
+        }
+        heap.push_back(std::make_pair(logit, static_cast<int32_t>(idx)));
+        std::push_heap(heap.begin(), heap.end(), comparePairs);
+        if (heap.size() > topk) {
+            std::pop_heap(heap.begin(), heap.end(), comparePairs);
+            heap.pop_back();
+        }
+    }
+    std::sort_heap(heap.begin(), heap.end(), comparePairs);
+
+    fasttext::real norm = max + std::log(sum);
+    for (auto &node : heap) {
+        node.first -= norm;
+    }
+}
+
+/**
+ * dot product with independent accumulators so the compiler can vectorise it
+ *
+ * @access private
+ * @param  const unaligned_real* a  a row of a dense or mapped matrix
+ * @param  const fasttext::real* b
+ * @param  int64_t n
+ * @return fasttext::real
+ */
+inline fasttext::real CFastText::_dot(const unaligned_real* __restrict a, const fasttext::real* __restrict b, int64_t n)
+{
+    fasttext::real acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+    int64_t idx = 0;
+    for (; idx + 8 <= n; idx += 8) {
+        for (int lane = 0; lane < 8; lane++) {
+            acc[lane] += a[idx + lane] * b[idx + lane];
+        }
+    }
+    for (; idx < n; idx++) {
+        acc[0] += a[idx] * b[idx];
+    }
+
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+}
+
+/**
+ * read a dense matrix header and map its rows instead of copying them
+ *
+ * @access private
+ * @param  std::istream& in  positioned on the matrix header
+ * @param  std::shared_ptr<CMappedFile> file
+ * @return std::shared_ptr<fasttext::Matrix>
+ */
+inline std::shared_ptr<fasttext::Matrix> CFastText::_mapMatrix(std::istream& in, std::shared_ptr<CMappedFile> file)
+{
+    int64_t m, n;
+    in.read((char*)&m, sizeof(int64_t));
+    in.read((char*)&n, sizeof(int64_t));
+    if (!in) {
+        throw std::invalid_argument("the model file is truncated!");
+    }
+
+    size_t offset = static_cast<size_t>(in.tellg());
+    auto matrix = std::make_shared<CMappedMatrix>(file, offset, m, n);
+    in.seekg(m * n * sizeof(fasttext::real), std::ios_base::cur);
+    return matrix;
+}
+
+/**
+ * load a model with the matrix sections read by a CParallelReader while
+ * this thread parses the dictionary; the section offsets are found by
+ * skipping over the dictionary in a mapping of the file first
+ *
+ * @access private
+ * @param  const std::string& filename
+ * @param  int threads
+ * @return void
+ */
+inline void CFastText::_loadParallel(const std::string& filename, int threads)
+{
+    CProbe probe(CProbe::SCOPE_PHASE, "load_parallel", this, filename.size(), threads);
+
+    std::ifstream ifs(filename, std::ifstream::binary);
+    if (!ifs.is_open()) {
+        throw std::invalid_argument(filename + " cannot be opened for loading!");
+    }
+    if (!checkModel(ifs)) {
+        throw std::invalid_argument(filename + " has wrong file format!");
+    }
+
+    args_ = std::make_shared<fasttext::Args>();
+    args_->load(ifs);
+    if (version == 11 && args_->model == fasttext::model_name::sup) {
+        // backward compatibility: old supervised models do not use char ngrams.
+        args_->maxn = 0;
+    }
+
+    int64_t inputRows, inputCols, outputRows, outputCols;
+    size_t inputAt, outputAt;
+    bool qout;
+    {
+        CMappedFile file(filename);
+        const char *data = file.data();
+        size_t offset = _skipDictionary(file, static_cast<size_t>(ifs.tellg()));
+
+        if (offset + 1 > file.size() || data[offset]) {
+            /* quantized models are small, nothing to gain from threads */
+            ifs.close();
+            loadModel(filename);
+            return;
+        }
+        offset += 1;
+
+        if (offset + 2 * sizeof(int64_t) > file.size()) {
+            throw std::invalid_argument(filename + " is truncated!");
+        }
+        std::memcpy(&inputRows, data + offset, sizeof(int64_t));
+        std::memcpy(&inputCols, data + offset + sizeof(int64_t), sizeof(int64_t));
+        if (0 > inputRows || 0 > inputCols) {
+            throw std::invalid_argument("Invalid model file.");
+        }
+        inputAt = offset + 2 * sizeof(int64_t);
+        offset = inputAt + inputRows * inputCols * sizeof(fasttext::real);
+
+        if (offset + 1 + 2 * sizeof(int64_t) > file.size()) {
+            throw std::invalid_argument(filename + " is truncated!");
+        }
+        qout = (0 != data[offset]);
+        std::memcpy(&outputRows, data + offset + 1, sizeof(int64_t));
+        std::memcpy(&outputCols, data + offset + 1 + sizeof(int64_t), sizeof(int64_t));
+        if (0 > outputRows || 0 > outputCols) {
+            throw std::invalid_argument("Invalid model file.");
+        }
+        outputAt = offset + 1 + 2 * sizeof(int64_t);
+
+        if (outputAt + outputRows * outputCols * sizeof(fasttext::real) > file.size()) {
+            throw std::invalid_argument(filename + " is truncated!");
+        }
+    }
+
+    /* CHeapMatrix is not zero-filled, the reader threads fault its pages in */
+    typedef std::shared_ptr<CHeapMatrix> dense_t;
+    std::future<std::pair<dense_t, dense_t>> matrices = std::async(std::launch::async,
+        [&filename, threads, inputRows, inputCols, inputAt, outputRows, outputCols, outputAt]() {
+            dense_t input = std::make_shared<CHeapMatrix>(inputRows, inputCols);
+            dense_t output = std::make_shared<CHeapMatrix>(outputRows, outputCols);
+
+            CParallelReader reader(filename, static_cast<size_t>(threads));
+            reader.add(inputAt, reinterpret_cast<char*>(input->data()),
+                inputRows * inputCols * sizeof(fasttext::real));
+            reader.add(outputAt, reinterpret_cast<char*>(output->data()),
+                outputRows * outputCols * sizeof(fasttext::real));
+            reader.run();
+
+            return std::make_pair(input, output);
+        }
+    );
+
+    dict_ = std::make_shared<fasttext::Dictionary>(args_, ifs);
+    std::pair<dense_t, dense_t> loaded = matrices.get();
+    if (dict_->isPruned()) {
+        throw std::invalid_argument("Invalid model file.");
+    }
+
+    quant_ = false;
+    input_ = loaded.first;
+    args_->qout = qout;
+    output_ = loaded.second;
+    buildModel();
+    _resetDerived();
+}
+
+/**
+ * offset of the first byte after a saved fasttext::Dictionary
+ *
+ * @access private
+ * @param  const CMappedFile& file
+ * @param  size_t offset  start of the dictionary
+ * @return size_t
+ */
+inline size_t CFastText::_skipDictionary(const CMappedFile& file, size_t offset)
+{
+    const char *data = file.data();
+    size_t size = file.size();
+    auto require = [size, &offset](size_t length) {
+        if (offset + length > size) {
+            throw std::invalid_argument("dictionary is truncated!");
+        }
+    };
+
+    int32_t entries;
+    int64_t pruned;
+    require(3 * sizeof(int32_t) + 2 * sizeof(int64_t));
+    std::memcpy(&entries, data + offset, sizeof(int32_t));
+    std::memcpy(&pruned, data + offset + 3 * sizeof(int32_t) + sizeof(int64_t), sizeof(int64_t));
+    offset += 3 * sizeof(int32_t) + 2 * sizeof(int64_t);
+
+    for (int32_t idx = 0; idx < entries; idx++) {
+        const char *end = static_cast<const char*>(std::memchr(data + offset, '\0', size - offset));
+        if (NULL == end) {
+            throw std::invalid_argument("dictionary is truncated!");
+        }
+        offset = static_cast<size_t>(end - data) + 1;
+        require(sizeof(int64_t) + sizeof(int8_t));
+        offset += sizeof(int64_t) + sizeof(int8_t);
+    }
+
+    if (0 < pruned) {
+        require(pruned * 2 * sizeof(int32_t));
+        offset += pruned * 2 * sizeof(int32_t);
+    }
+
+    return offset;
+}
+
+/**
+ * drop everything derived from the previous parameters
+ *
+ * @access private
+ * @return void
+ */
+inline void CFastText::_resetDerived(void)
+{
+    std::lock_guard<std::mutex> lock(_wordVectorsMutex);
+    wordVectors_.reset();
+    _wordVectorsReady.store(false, std::memory_order_release);
+    _wordCache.clear();
+    _ngramCache.clear();
+    _dictFingerprint.store(0);
+    _dictBytes.store(0);
+}
+
+/**
+ * row-major storage of a dense, heap or mapped matrix
+ *
+ * @access private
+ * @param  const fasttext::Matrix& matrix
+ * @return const unaligned_real*  nullptr for quantized matrices
+ */
+inline const unaligned_real *CFastText::_denseData(const fasttext::Matrix& matrix)
+{
+    if (auto dense = dynamic_cast<const fasttext::DenseMatrix*>(&matrix)) {
+        return dense->data();
+    }
+    if (auto heap = dynamic_cast<const CHeapMatrix*>(&matrix)) {
+        return heap->data();
+    }
+    if (auto mapped = dynamic_cast<const CMappedMatrix*>(&matrix)) {
+        return mapped->data();
+    }
+    return nullptr;
+}
+
+/**
+ * output matrix of a softmax classifier for _predictSoftmax
+ *
+ * @access private
+ * @return const unaligned_real*  nullptr when fastText has to predict
+ */
+inline const unaligned_real *CFastText::_softmaxOutput(void) const
+{
+    if (args_->loss != fasttext::loss_name::softmax || quant_) {
+        return nullptr;
+    }
+    return _denseData(*output_);
+}
+
 /**
  * parse a query format
  *
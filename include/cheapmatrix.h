@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+
+#include <fasttext/matrix.h>
+#include <fasttext/real.h>
+#include <fasttext/vector.h>
+
+namespace croco {
+
+/**
+ * CHeapMatrix
+ *
+ * dense matrix like fasttext::DenseMatrix whose storage is left
+ * uninitialised, so its pages are first touched by whoever fills the
+ * rows (the threads of a CParallelReader) instead of by a zero-fill on
+ * the allocating thread
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CHeapMatrix : public fasttext::Matrix {
+
+public:
+    CHeapMatrix(int64_t m, int64_t n);
+
+    fasttext::real *data(void);
+    const fasttext::real *data(void) const;
+    const fasttext::real *row(int64_t i) const;
+
+    fasttext::real dotRow(const fasttext::Vector& vec, int64_t i) const override;
+    void addVectorToRow(const fasttext::Vector& vec, int64_t i, fasttext::real a) override;
+    void addRowToVector(fasttext::Vector& x, int32_t i) const override;
+    void addRowToVector(fasttext::Vector& x, int32_t i, fasttext::real a) const override;
+    void save(std::ostream& out) const override;
+    void load(std::istream& in) override;
+    void dump(std::ostream& out) const override;
+
+private:
+    void _allocate(int64_t m, int64_t n);
+
+    std::unique_ptr<fasttext::real[]> _data;
+}; // class CHeapMatrix
+
+/**
+ * constructor, the values are undefined until the rows are written
+ *
+ * @access public
+ * @param  int64_t m
+ * @param  int64_t n
+ */
+inline CHeapMatrix::CHeapMatrix(int64_t m, int64_t n) : fasttext::Matrix(0, 0)
+{
+    _allocate(m, n);
+}
+
+/**
+ * data
+ *
+ * @access public
+ * @return fasttext::real*
+ */
+inline fasttext::real *CHeapMatrix::data(void)
+{
+    return _data.get();
+}
+
+/**
+ * data
+ *
+ * @access public
+ * @return const fasttext::real*
+ */
+inline const fasttext::real *CHeapMatrix::data(void) const
+{
+    return _data.get();
+}
+
+/**
+ * row
+ *
+ * @access public
+ * @param  int64_t i
+ * @return const fasttext::real*
+ */
+inline const fasttext::real *CHeapMatrix::row(int64_t i) const
+{
+    return _data.get() + i * n_;
+}
+
+/**
+ * dotRow
+ *
+ * @access public
+ * @param  const fasttext::Vector& vec
+ * @param  int64_t i
+ * @return fasttext::real
+ */
+inline fasttext::real CHeapMatrix::dotRow(const fasttext::Vector& vec, int64_t i) const
+{
+    const fasttext::real *r = row(i);
+    fasttext::real d = 0.0;
+    for (int64_t j = 0; j < n_; j++) {
+        d += r[j] * vec[j];
+    }
+    return d;
+}
+
+/**
+ * addVectorToRow
+ *
+ * @access public
+ * @param  const fasttext::Vector& vec
+ * @param  int64_t i
+ * @param  fasttext::real a
+ * @return void
+ */
+inline void CHeapMatrix::addVectorToRow(const fasttext::Vector& vec, int64_t i, fasttext::real a)
+{
+    fasttext::real *r = _data.get() + i * n_;
+    for (int64_t j = 0; j < n_; j++) {
+        r[j] += a * vec[j];
+    }
+}
+
+/**
+ * addRowToVector
+ *
+ * @access public
+ * @param  fasttext::Vector& x
+ * @param  int32_t i
+ * @return void
+ */
+inline void CHeapMatrix::addRowToVector(fasttext::Vector& x, int32_t i) const
+{
+    const fasttext::real *r = row(i);
+    for (int64_t j = 0; j < n_; j++) {
+        x[j] += r[j];
+    }
+}
+
+/**
+ * addRowToVector
+ *
+ * @access public
+ * @param  fasttext::Vector& x
+ * @param  int32_t i
+ * @param  fasttext::real a
+ * @return void
+ */
+inline void CHeapMatrix::addRowToVector(fasttext::Vector& x, int32_t i, fasttext::real a) const
+{
+    const fasttext::real *r = row(i);
+    for (int64_t j = 0; j < n_; j++) {
+        x[j] += a * r[j];
+    }
+}
+
+/**
+ * save in the same layout as fasttext::DenseMatrix
+ *
+ * @access public
+ * @param  std::ostream& out
+ * @return void
+ */
+inline void CHeapMatrix::save(std::ostream& out) const
+{
+    out.write((char*)&m_, sizeof(int64_t));
+    out.write((char*)&n_, sizeof(int64_t));
+    out.write((const char*)_data.get(), m_ * n_ * sizeof(fasttext::real));
+}
+
+/**
+ * load
+ *
+ * @access public
+ * @param  std::istream& in
+ * @return void
+ */
+inline void CHeapMatrix::load(std::istream& in)
+{
+    int64_t m, n;
+    in.read((char*)&m, sizeof(int64_t));
+    in.read((char*)&n, sizeof(int64_t));
+    _allocate(m, n);
+    in.read((char*)_data.get(), m_ * n_ * sizeof(fasttext::real));
+}
+
+/**
+ * dump
+ *
+ * @access public
+ * @param  std::ostream& out
+ * @return void
+ */
+inline void CHeapMatrix::dump(std::ostream& out) const
+{
+    out << m_ << " " << n_ << std::endl;
+    for (int64_t i = 0; i < m_; i++) {
+        for (int64_t j = 0; j < n_; j++) {
+            if (j > 0) {
+                out << " ";
+            }
+            out << row(i)[j];
+        }
+        out << std::endl;
+    }
+}
+
+/**
+ * default-initialised new[], large blocks are fresh mappings nobody has touched
+ *
+ * @access private
+ * @param  int64_t m
+ * @param  int64_t n
+ * @return void
+ */
+inline void CHeapMatrix::_allocate(int64_t m, int64_t n)
+{
+    if (0 > m || 0 > n) {
+        throw std::invalid_argument("Invalid model file.");
+    }
+    _data.reset(new fasttext::real[static_cast<size_t>(m * n)]);
+    m_ = m;
+    n_ = n;
+}
+
+} // namespace croco
@@ -0,0 +1,443 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fasttext/real.h>
+
+#include "cclusterindex.h"
+
+namespace croco {
+
+/**
+ * CKMeans
+ *
+ * k-means over row-major vectors with k-means++ seeding and either
+ * Lloyd iterations or mini-batch updates. rows are assigned by a
+ * CClusterIndex of the current centroids, and row ranges are handed to
+ * the caller's parallel_t
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CKMeans {
+
+public:
+    typedef std::function<void(size_t, size_t)> range_t;
+    typedef std::function<void(size_t, const range_t&)> parallel_t;
+
+    struct options_t {
+        int32_t k = 8;
+        int32_t iterations = 20;
+        int64_t batch = 0;
+        uint64_t seed = 0;
+    };
+
+    CKMeans(const fasttext::real *rows, int64_t n, int64_t dim);
+    void run(const options_t& options, parallel_t parallel, size_t workers);
+    const std::vector<fasttext::real>& centroids(void) const;
+    const std::vector<int32_t>& assignments(void) const;
+    std::vector<int64_t> sizes(void) const;
+    double inertia(void) const;
+    int32_t iterations(void) const;
+    const CClusterIndex& index(void) const;
+    void save(const std::string& filename) const;
+
+private:
+    void _seed(const std::vector<int64_t>& sample, std::mt19937_64& rng, parallel_t& parallel);
+    void _prepare(void);
+    int64_t _lloyd(parallel_t& parallel, size_t workers);
+    void _miniBatch(std::mt19937_64& rng, int64_t batch, parallel_t& parallel);
+    double _distance(int64_t row, int32_t c) const;
+
+    const fasttext::real *_rows;
+    int64_t _n;
+    int64_t _dim;
+    int32_t _k;
+    int32_t _iterations;
+    std::vector<fasttext::real> _norms;
+    std::vector<fasttext::real> _centroids;
+    CClusterIndex _index;
+    std::vector<int32_t> _labels;
+    std::vector<fasttext::real> _dists;
+    std::vector<int64_t> _seen;
+}; // class CKMeans
+
+/**
+ * constructor
+ *
+ * @access public
+ * @param  const fasttext::real *rows  n x dim, must outlive the object
+ * @param  int64_t n
+ * @param  int64_t dim
+ */
+inline CKMeans::CKMeans(const fasttext::real *rows, int64_t n, int64_t dim)
+    : _rows(rows), _n(n), _dim(dim), _k(0), _iterations(0), _norms(n)
+{
+    for (int64_t i = 0; i < _n; i++) {
+        const fasttext::real *row = _rows + i * _dim;
+        fasttext::real norm = 0.0;
+        for (int64_t d = 0; d < _dim; d++) {
+            norm += row[d] * row[d];
+        }
+        _norms[i] = norm;
+    }
+}
+
+/**
+ * cluster the rows
+ *
+ * @access public
+ * @param  const options_t& options
+ * @param  parallel_t parallel  runs a range_t over [0, count) split as it likes
+ * @param  size_t workers  number of ranges the Lloyd step keeps partial sums for
+ * @return void
+ */
+inline void CKMeans::run(const options_t& options, parallel_t parallel, size_t workers)
+{
+    if (0 >= options.k || _n < options.k) {
+        throw std::invalid_argument("k must be between 1 and the number of vectors");
+    }
+    _k = options.k;
+    _iterations = 0;
+    _labels.assign(_n, -1);
+    _dists.assign(_n, 0.0);
+    _seen.assign(_k, 0);
+
+    std::mt19937_64 rng(options.seed);
+
+    /* mini-batches are seeded from a sample, full runs from every row */
+    std::vector<int64_t> sample(_n);
+    for (int64_t i = 0; i < _n; i++) {
+        sample[i] = i;
+    }
+    if (0 < options.batch) {
+        int64_t size = std::min(_n, std::max<int64_t>(options.batch, 16 * static_cast<int64_t>(_k)));
+        for (int64_t i = 0; i < size; i++) {
+            std::uniform_int_distribution<int64_t> pick(i, _n - 1);
+            std::swap(sample[i], sample[pick(rng)]);
+        }
+        sample.resize(size);
+    }
+    _seed(sample, rng, parallel);
+
+    if (0 < options.batch) {
+        for (; _iterations < options.iterations; _iterations++) {
+            _miniBatch(rng, std::min(options.batch, _n), parallel);
+        }
+        _prepare();
+        parallel(static_cast<size_t>(_n), [this](size_t begin, size_t end) {
+            _index.assign(_rows, _norms.data(), begin, end, _labels.data() + begin, _dists.data() + begin);
+        });
+        return;
+    }
+
+    while (_iterations < options.iterations) {
+        _iterations++;
+        if (0 == _lloyd(parallel, std::max<size_t>(1, workers))) {
+            break;
+        }
+    }
+    _prepare();
+    parallel(static_cast<size_t>(_n), [this](size_t begin, size_t end) {
+        _index.assign(_rows, _norms.data(), begin, end, _labels.data() + begin, _dists.data() + begin);
+    });
+}
+
+/**
+ * centroids
+ *
+ * @access public
+ * @return const std::vector<fasttext::real>&  k x dim
+ */
+inline const std::vector<fasttext::real>& CKMeans::centroids(void) const
+{
+    return _centroids;
+}
+
+/**
+ * assignments
+ *
+ * @access public
+ * @return const std::vector<int32_t>&
+ */
+inline const std::vector<int32_t>& CKMeans::assignments(void) const
+{
+    return _labels;
+}
+
+/**
+ * sizes
+ *
+ * @access public
+ * @return std::vector<int64_t>  rows per cluster
+ */
+inline std::vector<int64_t> CKMeans::sizes(void) const
+{
+    std::vector<int64_t> sizes(_k, 0);
+    for (int32_t label : _labels) {
+        sizes[label]++;
+    }
+    return sizes;
+}
+
+/**
+ * inertia
+ *
+ * @access public
+ * @return double  sum of squared distances to the assigned centroids
+ */
+inline double CKMeans::inertia(void) const
+{
+    double sum = 0.0;
+    for (fasttext::real dist : _dists) {
+        sum += dist;
+    }
+    return sum;
+}
+
+/**
+ * iterations
+ *
+ * @access public
+ * @return int32_t
+ */
+inline int32_t CKMeans::iterations(void) const
+{
+    return _iterations;
+}
+
+/**
+ * index of the final centroids, for the nearest cluster of other rows
+ *
+ * @access public
+ * @return const CClusterIndex&
+ */
+inline const CClusterIndex& CKMeans::index(void) const
+{
+    return _index;
+}
+
+/**
+ * save the centroids in the text format of fastText .vec files, the
+ * word of each row is its cluster number; CClusterIndex::load() reads
+ * them back
+ *
+ * @access public
+ * @param  const std::string& filename
+ * @return void
+ */
+inline void CKMeans::save(const std::string& filename) const
+{
+    _index.save(filename);
+}
+
+/**
+ * k-means++ seeding over the sampled rows
+ *
+ * @access private
+ * @param  const std::vector<int64_t>& sample
+ * @param  std::mt19937_64& rng
+ * @param  parallel_t& parallel
+ * @return void
+ */
+inline void CKMeans::_seed(const std::vector<int64_t>& sample, std::mt19937_64& rng, parallel_t& parallel)
+{
+    _centroids.assign(_k * _dim, 0.0);
+    std::vector<double> nearest(sample.size(), std::numeric_limits<double>::max());
+
+    std::uniform_int_distribution<size_t> first(0, sample.size() - 1);
+    int64_t chosen = sample[first(rng)];
+
+    for (int32_t c = 0; c < _k; c++) {
+        std::copy(_rows + chosen * _dim, _rows + (chosen + 1) * _dim, _centroids.begin() + c * _dim);
+        if (c + 1 == _k) {
+            break;
+        }
+
+        parallel(sample.size(), [this, &sample, &nearest, c](size_t begin, size_t end) {
+            for (size_t idx = begin; idx < end; idx++) {
+                nearest[idx] = std::min(nearest[idx], _distance(sample[idx], c));
+            }
+        });
+
+        double total = 0.0;
+        for (double dist : nearest) {
+            total += dist;
+        }
+        if (0.0 >= total) {
+            /* fewer distinct rows than clusters */
+            chosen = sample[first(rng)];
+            continue;
+        }
+
+        double target = std::uniform_real_distribution<double>(0.0, total)(rng);
+        size_t idx = 0;
+        for (; idx + 1 < nearest.size(); idx++) {
+            target -= nearest[idx];
+            if (0.0 >= target) {
+                break;
+            }
+        }
+        chosen = sample[idx];
+    }
+}
+
+/**
+ * index the current centroids for the next assignment
+ *
+ * @access private
+ * @return void
+ */
+inline void CKMeans::_prepare(void)
+{
+    _index = CClusterIndex(_centroids.data(), _k, _dim);
+}
+
+/**
+ * one Lloyd iteration: assign every row, then move each centroid to the
+ * mean of its rows. an empty cluster takes over the row farthest from
+ * its own centroid
+ *
+ * @access private
+ * @param  parallel_t& parallel
+ * @param  size_t workers
+ * @return int64_t  rows whose cluster changed
+ */
+inline int64_t CKMeans::_lloyd(parallel_t& parallel, size_t workers)
+{
+    _prepare();
+
+    size_t parts = std::min<size_t>(workers, static_cast<size_t>(_n));
+    int64_t step = (_n + parts - 1) / parts;
+    std::vector<std::vector<double>> sums(parts);
+    std::vector<std::vector<int64_t>> counts(parts);
+    std::vector<int64_t> changed(parts, 0);
+
+    parallel(parts, [this, step, &sums, &counts, &changed](size_t first, size_t last) {
+        std::vector<int32_t> labels;
+        for (size_t part = first; part < last; part++) {
+            int64_t begin = part * step;
+            int64_t end = std::min(_n, begin + step);
+            labels.resize(std::max<int64_t>(0, end - begin));
+            sums[part].assign(_k * _dim, 0.0);
+            counts[part].assign(_k, 0);
+            if (begin >= end) {
+                continue;
+            }
+
+            _index.assign(_rows, _norms.data(), begin, end, labels.data(), _dists.data() + begin);
+            for (int64_t i = begin; i < end; i++) {
+                int32_t label = labels[i - begin];
+                if (label != _labels[i]) {
+                    changed[part]++;
+                    _labels[i] = label;
+                }
+                counts[part][label]++;
+
+                const fasttext::real *row = _rows + i * _dim;
+                double *sum = sums[part].data() + label * _dim;
+                for (int64_t d = 0; d < _dim; d++) {
+                    sum[d] += row[d];
+                }
+            }
+        }
+    });
+
+    for (size_t part = 1; part < parts; part++) {
+        for (int64_t idx = 0; idx < _k * _dim; idx++) {
+            sums[0][idx] += sums[part][idx];
+        }
+        for (int32_t c = 0; c < _k; c++) {
+            counts[0][c] += counts[part][c];
+        }
+        changed[0] += changed[part];
+    }
+
+    for (int32_t c = 0; c < _k; c++) {
+        fasttext::real *centroid = _centroids.data() + c * _dim;
+        if (0 < counts[0][c]) {
+            for (int64_t d = 0; d < _dim; d++) {
+                centroid[d] = static_cast<fasttext::real>(sums[0][c * _dim + d] / counts[0][c]);
+            }
+            continue;
+        }
+
+        int64_t farthest = std::max_element(_dists.begin(), _dists.end()) - _dists.begin();
+        std::copy(_rows + farthest * _dim, _rows + (farthest + 1) * _dim, centroid);
+        _dists[farthest] = 0.0;
+        changed[0]++;
+    }
+
+    return changed[0];
+}
+
+/**
+ * one mini-batch step: assign a random batch, then pull each centroid
+ * towards its rows with a per-centroid learning rate of 1 / count
+ *
+ * @access private
+ * @param  std::mt19937_64& rng
+ * @param  int64_t batch
+ * @param  parallel_t& parallel
+ * @return void
+ */
+inline void CKMeans::_miniBatch(std::mt19937_64& rng, int64_t batch, parallel_t& parallel)
+{
+    _prepare();
+
+    std::uniform_int_distribution<int64_t> pick(0, _n - 1);
+    std::vector<int64_t> picked(batch);
+    std::vector<fasttext::real> rows(batch * _dim), norms(batch);
+    for (int64_t idx = 0; idx < batch; idx++) {
+        picked[idx] = pick(rng);
+        std::copy(_rows + picked[idx] * _dim, _rows + (picked[idx] + 1) * _dim, rows.begin() + idx * _dim);
+        norms[idx] = _norms[picked[idx]];
+    }
+
+    std::vector<int32_t> labels(batch);
+    std::vector<fasttext::real> dists(batch);
+    parallel(static_cast<size_t>(batch), [this, &rows, &norms, &labels, &dists](size_t begin, size_t end) {
+        _index.assign(rows.data(), norms.data(), begin, end, labels.data() + begin, dists.data() + begin);
+    });
+
+    for (int64_t idx = 0; idx < batch; idx++) {
+        int32_t c = labels[idx];
+        _seen[c]++;
+        fasttext::real eta = static_cast<fasttext::real>(1.0 / _seen[c]);
+        fasttext::real *centroid = _centroids.data() + c * _dim;
+        const fasttext::real *row = rows.data() + idx * _dim;
+        for (int64_t d = 0; d < _dim; d++) {
+            centroid[d] += eta * (row[d] - centroid[d]);
+        }
+    }
+}
+
+/**
+ * squared distance between a row and a centroid
+ *
+ * @access private
+ * @param  int64_t row
+ * @param  int32_t c
+ * @return double
+ */
+inline double CKMeans::_distance(int64_t row, int32_t c) const
+{
+    const fasttext::real *x = _rows + row * _dim;
+    const fasttext::real *centroid = _centroids.data() + c * _dim;
+    double dist = 0.0;
+    for (int64_t d = 0; d < _dim; d++) {
+        double diff = x[d] - centroid[d];
+        dist += diff * diff;
+    }
+    return dist;
+}
+
+} // namespace croco
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace croco {
+
+/**
+ * CLruCache
+ *
+ * bounded least-recently-used cache keyed by string. bytes() is an
+ * estimate of the heap held by the entries, the value part of it is
+ * given by the sizer
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+template <typename T>
+class CLruCache {
+
+public:
+    typedef std::function<size_t(const T&)> sizer_t;
+
+    explicit CLruCache(size_t capacity = 0, sizer_t sizer = sizer_t());
+    void setCapacity(size_t capacity);
+    bool get(const std::string& key, T& value);
+    void put(const std::string& key, const T& value);
+    void clear();
+    size_t size();
+    size_t capacity();
+    size_t bytes();
+    uint64_t hits();
+    uint64_t misses();
+
+private:
+    typedef std::list<std::pair<std::string, T>> entries_t;
+
+    void _shrink(void);
+    size_t _entryBytes(const std::string& key, const T& value) const;
+
+    std::mutex _mutex;
+    sizer_t _sizer;
+    size_t _capacity;
+    std::atomic<size_t> _bytes;
+    uint64_t _hits;
+    uint64_t _misses;
+    entries_t _entries;
+    std::unordered_map<std::string, typename entries_t::iterator> _index;
+}; // class CLruCache
+
+/**
+ * constructor
+ *
+ * @access public
+ * @param  size_t capacity  0 disables the cache
+ * @param  sizer_t sizer  heap bytes of a value, sizeof(T) when empty
+ */
+template <typename T>
+inline CLruCache<T>::CLruCache(size_t capacity, sizer_t sizer)
+    : _sizer(sizer), _capacity(capacity), _bytes(0), _hits(0), _misses(0)
+{
+}
+
+/**
+ * setCapacity
+ *
+ * @access public
+ * @param  size_t capacity
+ * @return void
+ */
+template <typename T>
+inline void CLruCache<T>::setCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _capacity = capacity;
+    _shrink();
+}
+
+/**
+ * get
+ *
+ * @access public
+ * @param  const std::string& key
+ * @param  T& value
+ * @return bool
+ */
+template <typename T>
+inline bool CLruCache<T>::get(const std::string& key, T& value)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _index.find(key);
+    if (it == _index.end()) {
+        _misses++;
+        return false;
+    }
+
+    _entries.splice(_entries.begin(), _entries, it->second);
+    value = it->second->second;
+    _hits++;
+    return true;
+}
+
+/**
+ * put
+ *
+ * @access public
+ * @param  const std::string& key
+ * @param  const T& value
+ * @return void
+ */
+template <typename T>
+inline void CLruCache<T>::put(const std::string& key, const T& value)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (0 == _capacity) {
+        return;
+    }
+
+    auto it = _index.find(key);
+    if (it != _index.end()) {
+        _bytes -= _entryBytes(key, it->second->second);
+        _bytes += _entryBytes(key, value);
+        it->second->second = value;
+        _entries.splice(_entries.begin(), _entries, it->second);
+        return;
+    }
+
+    _entries.emplace_front(key, value);
+    _index[key] = _entries.begin();
+    _bytes += _entryBytes(key, value);
+    _shrink();
+}
+
+/**
+ * clear
+ *
+ * @access public
+ * @return void
+ */
+template <typename T>
+inline void CLruCache<T>::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+    _index.clear();
+    _bytes = 0;
+    _hits = 0;
+    _misses = 0;
+}
+
+/**
+ * size
+ *
+ * @access public
+ * @return size_t
+ */
+template <typename T>
+inline size_t CLruCache<T>::size()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+/**
+ * capacity
+ *
+ * @access public
+ * @return size_t
+ */
+template <typename T>
+inline size_t CLruCache<T>::capacity()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _capacity;
+}
+
+/**
+ * bytes
+ *
+ * written under the mutex on insert and eviction, read without it so
+ * that getFootprint() does not contend with the cache users
+ *
+ * @access public
+ * @return size_t
+ */
+template <typename T>
+inline size_t CLruCache<T>::bytes()
+{
+    return _bytes.load(std::memory_order_relaxed);
+}
+
+/**
+ * hits
+ *
+ * @access public
+ * @return uint64_t
+ */
+template <typename T>
+inline uint64_t CLruCache<T>::hits()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _hits;
+}
+
+/**
+ * misses
+ *
+ * @access public
+ * @return uint64_t
+ */
+template <typename T>
+inline uint64_t CLruCache<T>::misses()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _misses;
+}
+
+/**
+ * drop the least recently used entries over capacity
+ *
+ * @access private
+ * @return void
+ */
+template <typename T>
+inline void CLruCache<T>::_shrink(void)
+{
+    while (_entries.size() > _capacity) {
+        _bytes -= _entryBytes(_entries.back().first, _entries.back().second);
+        _index.erase(_entries.back().first);
+        _entries.pop_back();
+    }
+}
+
+/**
+ * list node, index node and key of an entry plus its value
+ *
+ * @access private
+ * @param  const std::string& key
+ * @param  const T& value
+ * @return size_t
+ */
+template <typename T>
+inline size_t CLruCache<T>::_entryBytes(const std::string& key, const T& value) const
+{
+    size_t bytes = 2 * key.size() + 96;
+    return bytes + (_sizer ? _sizer(value) : sizeof(T));
+}
+
+} // namespace croco
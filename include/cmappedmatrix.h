@@ -0,0 +1,336 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fasttext/matrix.h>
+#include <fasttext/real.h>
+#include <fasttext/vector.h>
+
+namespace croco {
+
+/* fasttext::real read from any address; fastText does not pad its model
+   files, so a matrix usually starts at an offset which is not a multiple
+   of sizeof(real) */
+typedef fasttext::real unaligned_real __attribute__((aligned(1)));
+
+/**
+ * CMappedFile
+ *
+ * read-only memory mapping of a whole model file
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CMappedFile {
+
+public:
+    explicit CMappedFile(const std::string& filename);
+    ~CMappedFile();
+    const char *data(void) const;
+    size_t size(void) const;
+    void advise(size_t offset, size_t length, int advice) const;
+
+private:
+    CMappedFile(const CMappedFile&) = delete;
+    CMappedFile& operator=(const CMappedFile&) = delete;
+
+    void *_addr;
+    size_t _size;
+}; // class CMappedFile
+
+/**
+ * constructor
+ *
+ * @access public
+ * @param  const std::string& filename
+ */
+inline CMappedFile::CMappedFile(const std::string& filename) : _addr(MAP_FAILED), _size(0)
+{
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (-1 == fd) {
+        throw std::invalid_argument(filename + " cannot be opened for loading!");
+    }
+
+    struct stat st;
+    if (0 == fstat(fd, &st) && 0 < st.st_size) {
+        _size = static_cast<size_t>(st.st_size);
+        _addr = mmap(NULL, _size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (MAP_FAILED == _addr) {
+        throw std::runtime_error(filename + " cannot be mapped into memory!");
+    }
+}
+
+/**
+ * destructor
+ *
+ * @access public
+ */
+inline CMappedFile::~CMappedFile()
+{
+    munmap(_addr, _size);
+}
+
+/**
+ * data
+ *
+ * @access public
+ * @return const char*
+ */
+inline const char *CMappedFile::data(void) const
+{
+    return static_cast<const char*>(_addr);
+}
+
+/**
+ * size
+ *
+ * @access public
+ * @return size_t
+ */
+inline size_t CMappedFile::size(void) const
+{
+    return _size;
+}
+
+/**
+ * madvise() a byte range, widened to whole pages
+ *
+ * @access public
+ * @param  size_t offset
+ * @param  size_t length
+ * @param  int advice  MADV_*
+ * @return void
+ */
+inline void CMappedFile::advise(size_t offset, size_t length, int advice) const
+{
+    if (0 == length || offset >= _size) {
+        return;
+    }
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = offset - (offset % page);
+    size_t end = std::min(offset + length, _size);
+
+    madvise(static_cast<char*>(_addr) + begin, end - begin, advice);
+}
+
+/**
+ * CMappedMatrix
+ *
+ * dense matrix whose rows stay in the page cache until they are touched
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CMappedMatrix : public fasttext::Matrix {
+
+public:
+    CMappedMatrix(std::shared_ptr<CMappedFile> file, size_t offset, int64_t m, int64_t n);
+
+    const unaligned_real *data(void) const;
+    const unaligned_real *row(int64_t i) const;
+    void advise(int64_t i, int advice) const;
+    void advise(int advice) const;
+
+    fasttext::real dotRow(const fasttext::Vector& vec, int64_t i) const override;
+    void addVectorToRow(const fasttext::Vector& vec, int64_t i, fasttext::real a) override;
+    void addRowToVector(fasttext::Vector& x, int32_t i) const override;
+    void addRowToVector(fasttext::Vector& x, int32_t i, fasttext::real a) const override;
+    void save(std::ostream& out) const override;
+    void load(std::istream& in) override;
+    void dump(std::ostream& out) const override;
+
+private:
+    std::shared_ptr<CMappedFile> _file;
+    size_t _offset;
+    const unaligned_real *_data;
+}; // class CMappedMatrix
+
+/**
+ * constructor
+ *
+ * @access public
+ * @param  std::shared_ptr<CMappedFile> file
+ * @param  size_t offset  byte offset of the first row, any alignment
+ * @param  int64_t m
+ * @param  int64_t n
+ */
+inline CMappedMatrix::CMappedMatrix(std::shared_ptr<CMappedFile> file, size_t offset, int64_t m, int64_t n)
+    : fasttext::Matrix(m, n), _file(file), _offset(offset)
+{
+    if (0 > m || 0 > n || offset + m * n * sizeof(fasttext::real) > file->size()) {
+        throw std::invalid_argument("matrix cannot be mapped from the model file");
+    }
+    _data = reinterpret_cast<const unaligned_real*>(file->data() + offset);
+}
+
+/**
+ * data
+ *
+ * @access public
+ * @return const unaligned_real*
+ */
+inline const unaligned_real *CMappedMatrix::data(void) const
+{
+    return _data;
+}
+
+/**
+ * row
+ *
+ * @access public
+ * @param  int64_t i
+ * @return const unaligned_real*
+ */
+inline const unaligned_real *CMappedMatrix::row(int64_t i) const
+{
+    return _data + i * n_;
+}
+
+/**
+ * advise one row
+ *
+ * @access public
+ * @param  int64_t i
+ * @param  int advice  MADV_*
+ * @return void
+ */
+inline void CMappedMatrix::advise(int64_t i, int advice) const
+{
+    _file->advise(_offset + i * n_ * sizeof(fasttext::real), n_ * sizeof(fasttext::real), advice);
+}
+
+/**
+ * advise the whole matrix
+ *
+ * @access public
+ * @param  int advice  MADV_*
+ * @return void
+ */
+inline void CMappedMatrix::advise(int advice) const
+{
+    _file->advise(_offset, m_ * n_ * sizeof(fasttext::real), advice);
+}
+
+/**
+ * dotRow
+ *
+ * @access public
+ * @param  const fasttext::Vector& vec
+ * @param  int64_t i
+ * @return fasttext::real
+ */
+inline fasttext::real CMappedMatrix::dotRow(const fasttext::Vector& vec, int64_t i) const
+{
+    const unaligned_real *r = row(i);
+    fasttext::real d = 0.0;
+    for (int64_t j = 0; j < n_; j++) {
+        d += r[j] * vec[j];
+    }
+    return d;
+}
+
+/**
+ * addVectorToRow
+ *
+ * @access public
+ * @throws std::runtime_error  the mapping is read-only
+ */
+inline void CMappedMatrix::addVectorToRow(const fasttext::Vector&, int64_t, fasttext::real)
+{
+    throw std::runtime_error("a lazily loaded model is read-only");
+}
+
+/**
+ * addRowToVector
+ *
+ * @access public
+ * @param  fasttext::Vector& x
+ * @param  int32_t i
+ * @return void
+ */
+inline void CMappedMatrix::addRowToVector(fasttext::Vector& x, int32_t i) const
+{
+    const unaligned_real *r = row(i);
+    for (int64_t j = 0; j < n_; j++) {
+        x[j] += r[j];
+    }
+}
+
+/**
+ * addRowToVector
+ *
+ * @access public
+ * @param  fasttext::Vector& x
+ * @param  int32_t i
+ * @param  fasttext::real a
+ * @return void
+ */
+inline void CMappedMatrix::addRowToVector(fasttext::Vector& x, int32_t i, fasttext::real a) const
+{
+    const unaligned_real *r = row(i);
+    for (int64_t j = 0; j < n_; j++) {
+        x[j] += a * r[j];
+    }
+}
+
+/**
+ * save in the same layout as fasttext::DenseMatrix
+ *
+ * @access public
+ * @param  std::ostream& out
+ * @return void
+ */
+inline void CMappedMatrix::save(std::ostream& out) const
+{
+    out.write((char*)&m_, sizeof(int64_t));
+    out.write((char*)&n_, sizeof(int64_t));
+    out.write((const char*)_data, m_ * n_ * sizeof(fasttext::real));
+}
+
+/**
+ * load
+ *
+ * @access public
+ * @throws std::runtime_error  rows always come from the mapping
+ */
+inline void CMappedMatrix::load(std::istream&)
+{
+    throw std::runtime_error("a mapped matrix cannot be loaded from a stream");
+}
+
+/**
+ * dump
+ *
+ * @access public
+ * @param  std::ostream& out
+ * @return void
+ */
+inline void CMappedMatrix::dump(std::ostream& out) const
+{
+    out << m_ << " " << n_ << std::endl;
+    for (int64_t i = 0; i < m_; i++) {
+        for (int64_t j = 0; j < n_; j++) {
+            if (j > 0) {
+                out << " ";
+            }
+            out << row(i)[j];
+        }
+        out << std::endl;
+    }
+}
+
+} // namespace croco
@@ -0,0 +1,488 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "cfasttext.h"
+
+namespace croco {
+
+/**
+ * CModelEntry
+ *
+ * a model as seen by a fastText object; shared entries can be evicted
+ * by the registry and are loaded again on their next use. the counters
+ * read on every acquire are atomic, _model and _bytes are only written
+ * under the registry mutex
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CModelEntry {
+
+public:
+    typedef std::shared_ptr<CFastText> model_t;
+    typedef std::function<model_t()> loader_t;
+
+    explicit CModelEntry(model_t model);
+    CModelEntry(const std::string& key, const std::string& path, const std::string& identity, loader_t loader);
+
+private:
+    friend class CModelRegistry;
+
+    std::string _key;
+    std::string _path;
+    std::string _identity;
+    loader_t _loader;
+    model_t _model;
+    bool _shared;
+    bool _pinned;
+    bool _retired;
+    std::atomic<size_t> _bytes;
+    std::atomic<uint64_t> _lastUse;
+    std::atomic<uint64_t> _hits;
+    uint64_t _loads;
+    std::mutex _loadMutex;
+}; // class CModelEntry
+
+/**
+ * constructor of a private entry, never evicted
+ *
+ * @access public
+ * @param  model_t model
+ */
+inline CModelEntry::CModelEntry(model_t model)
+    : _model(model), _shared(false), _pinned(true), _retired(false),
+      _bytes(0), _lastUse(0), _hits(0), _loads(1)
+{
+}
+
+/**
+ * constructor of a shared entry
+ *
+ * @access public
+ * @param  const std::string& key
+ * @param  const std::string& path  resolved model file
+ * @param  const std::string& identity  from CModelRegistry::identify()
+ * @param  loader_t loader
+ */
+inline CModelEntry::CModelEntry(const std::string& key, const std::string& path, const std::string& identity, loader_t loader)
+    : _key(key), _path(path), _identity(identity), _loader(loader),
+      _shared(true), _pinned(false), _retired(false),
+      _bytes(0), _lastUse(0), _hits(0), _loads(0)
+{
+}
+
+/**
+ * CModelRegistry
+ *
+ * process-wide cache of shared models kept under a byte budget by
+ * evicting the least recently used unpinned ones
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CModelRegistry {
+
+public:
+    typedef std::shared_ptr<CModelEntry> entry_t;
+    typedef CModelEntry::model_t model_t;
+
+    /* smaller changes of a loaded footprint, e.g. a few cached words, are not accounted */
+    static const size_t FOOTPRINT_STEP = 1 << 20;
+
+    struct stats_t {
+        std::string key;
+        size_t bytes;
+        bool pinned;
+        bool loaded;
+        uint64_t hits;
+        uint64_t loads;
+    };
+
+    static CModelRegistry& instance(void);
+    static std::string identify(const std::string& filename, std::string& path);
+    entry_t entry(const std::string& key, const std::string& path, const std::string& identity,
+                  CModelEntry::loader_t loader, bool pin, bool *found = NULL);
+    size_t drop(const std::string& filename);
+    model_t acquire(const entry_t& entry);
+    void setBudget(size_t budget);
+    size_t getBudget(void);
+    size_t getBytes(void);
+    uint64_t getEvictions(void);
+    uint64_t getReloads(void);
+    std::vector<stats_t> getStats(void);
+    void clear(void);
+
+private:
+    CModelRegistry() = default;
+
+    void _account(CModelEntry& entry, size_t bytes);
+    void _evict(const CModelEntry *keep);
+    void _retire(std::map<std::string, entry_t>::iterator it);
+
+    std::mutex _mutex;
+    std::map<std::string, entry_t> _entries;
+    size_t _budget = 0;
+    size_t _bytes = 0;
+    std::atomic<uint64_t> _clock{0};
+    uint64_t _evictions = 0;
+    uint64_t _reloads = 0;
+}; // class CModelRegistry
+
+/**
+ * instance
+ *
+ * @access public
+ * @return CModelRegistry&
+ */
+inline CModelRegistry& CModelRegistry::instance(void)
+{
+    static CModelRegistry registry;
+    return registry;
+}
+
+/**
+ * resolve a model file and describe the version on disk, a file
+ * rewritten or replaced at the same path gets another identity
+ *
+ * @access public
+ * @param  const std::string& filename
+ * @param  std::string& path  absolute path without symbolic links
+ * @return std::string  device, inode, size and modification time
+ * @throws std::invalid_argument
+ */
+inline std::string CModelRegistry::identify(const std::string& filename, std::string& path)
+{
+    char resolved[PATH_MAX];
+    struct stat st;
+    if (NULL == realpath(filename.c_str(), resolved) || 0 != stat(resolved, &st)) {
+        throw std::invalid_argument(filename + " cannot be opened for loading!");
+    }
+    path = resolved;
+
+    return std::to_string(st.st_dev) + ":" + std::to_string(st.st_ino) + ":" +
+        std::to_string(st.st_size) + ":" + std::to_string(st.st_mtim.tv_sec) + "." +
+        std::to_string(st.st_mtim.tv_nsec);
+}
+
+/**
+ * find or register a shared entry, nothing is loaded yet
+ *
+ * an entry of an older version of the file is retired: it leaves the
+ * cache, the objects which use it keep their model
+ *
+ * @access public
+ * @param  const std::string& key
+ * @param  const std::string& path  resolved model file
+ * @param  const std::string& identity  from identify()
+ * @param  CModelEntry::loader_t loader
+ * @param  bool pin  keep the model loaded whatever the budget
+ * @param  bool *found  set to true when the entry was already registered
+ * @return entry_t
+ */
+inline CModelRegistry::entry_t CModelRegistry::entry(
+    const std::string& key,
+    const std::string& path,
+    const std::string& identity,
+    CModelEntry::loader_t loader,
+    bool pin,
+    bool *found
+)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto it = _entries.find(key);
+    if (it != _entries.end() && it->second->_identity != identity) {
+        _retire(it);
+        it = _entries.end();
+    }
+    if (NULL != found) {
+        *found = (it != _entries.end());
+    }
+    if (it == _entries.end()) {
+        it = _entries.emplace(key, std::make_shared<CModelEntry>(key, path, identity, loader)).first;
+    }
+    if (pin) {
+        it->second->_pinned = true;
+    }
+
+    return it->second;
+}
+
+/**
+ * remove every entry of a file from the cache, pinned or not; the
+ * objects which use them keep their model until they load another one
+ *
+ * @access public
+ * @param  const std::string& filename
+ * @return size_t  number of entries removed
+ */
+inline size_t CModelRegistry::drop(const std::string& filename)
+{
+    char resolved[PATH_MAX];
+    std::string path = (NULL != realpath(filename.c_str(), resolved)) ? std::string(resolved) : filename;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    size_t count = 0;
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        auto next = std::next(it);
+        if (it->second->_path == path) {
+            _retire(it);
+            count++;
+        }
+        it = next;
+    }
+    return count;
+}
+
+/**
+ * acquire
+ *
+ * the returned reference keeps the model alive for the caller even if
+ * the registry evicts it meanwhile. a loaded model is handed out without
+ * the registry mutex, which is only taken when its footprint changed
+ *
+ * @access public
+ * @param  const entry_t& entry
+ * @return model_t
+ */
+inline CModelRegistry::model_t CModelRegistry::acquire(const entry_t& entry)
+{
+    if (!entry->_shared) {
+        return entry->_model;
+    }
+
+    model_t model = std::atomic_load(&entry->_model);
+    if (model) {
+        entry->_hits.fetch_add(1, std::memory_order_relaxed);
+        entry->_lastUse.store(++_clock, std::memory_order_relaxed);
+
+        size_t bytes = model->getFootprint();
+        size_t known = entry->_bytes.load(std::memory_order_relaxed);
+        if (FOOTPRINT_STEP <= std::max(bytes, known) - std::min(bytes, known)) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (model == entry->_model) {
+                _account(*entry, bytes);
+            }
+        }
+        return model;
+    }
+
+    std::lock_guard<std::mutex> loading(entry->_loadMutex);
+    model = std::atomic_load(&entry->_model);
+    if (model) {
+        entry->_lastUse.store(++_clock, std::memory_order_relaxed);
+        return model;
+    }
+
+    try {
+        model = entry->_loader();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _entries.find(entry->_key);
+        if (0 == entry->_loads && it != _entries.end() && it->second == entry) {
+            _entries.erase(it);
+        }
+        throw;
+    }
+    size_t bytes = model->getFootprint();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (0 < entry->_loads++) {
+        _reloads++;
+    }
+    std::atomic_store(&entry->_model, model);
+    entry->_lastUse.store(++_clock, std::memory_order_relaxed);
+    _account(*entry, bytes);
+
+    return model;
+}
+
+/**
+ * setBudget
+ *
+ * @access public
+ * @param  size_t budget  bytes, 0 for no limit
+ * @return void
+ */
+inline void CModelRegistry::setBudget(size_t budget)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _budget = budget;
+    _evict(NULL);
+}
+
+/**
+ * getBudget
+ *
+ * @access public
+ * @return size_t
+ */
+inline size_t CModelRegistry::getBudget(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _budget;
+}
+
+/**
+ * getBytes
+ *
+ * @access public
+ * @return size_t
+ */
+inline size_t CModelRegistry::getBytes(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _bytes;
+}
+
+/**
+ * getEvictions
+ *
+ * @access public
+ * @return uint64_t
+ */
+inline uint64_t CModelRegistry::getEvictions(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _evictions;
+}
+
+/**
+ * getReloads
+ *
+ * @access public
+ * @return uint64_t
+ */
+inline uint64_t CModelRegistry::getReloads(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _reloads;
+}
+
+/**
+ * getStats
+ *
+ * @access public
+ * @return std::vector<stats_t>
+ */
+inline std::vector<CModelRegistry::stats_t> CModelRegistry::getStats(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::vector<stats_t> stats;
+    for (auto &node : _entries) {
+        const CModelEntry &entry = *node.second;
+        stats.push_back(stats_t{
+            entry._key, entry._bytes.load(), entry._pinned,
+            static_cast<bool>(entry._model), entry._hits.load(), entry._loads
+        });
+    }
+    return stats;
+}
+
+/**
+ * clear
+ *
+ * @access public
+ * @return void
+ */
+inline void CModelRegistry::clear(void)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto &node : _entries) {
+        std::atomic_store(&node.second->_model, model_t());
+    }
+    _entries.clear();
+    _bytes = 0;
+}
+
+/**
+ * record the footprint of a loaded entry, which grows once the word
+ * vectors of getNN have been built or the caches fill up, and evict
+ * others when it exceeds the budget
+ *
+ * the registry mutex is held
+ *
+ * @access private
+ * @param  CModelEntry& entry
+ * @param  size_t bytes  getFootprint() of its model
+ * @return void
+ */
+inline void CModelRegistry::_account(CModelEntry& entry, size_t bytes)
+{
+    /* a retired entry is out of the cache, its model goes with its last user */
+    if (entry._retired) {
+        return;
+    }
+    _bytes = _bytes - entry._bytes.load() + bytes;
+    entry._bytes.store(bytes);
+
+    if (_budget < _bytes && 0 < _budget) {
+        _evict(&entry);
+    }
+}
+
+/**
+ * evict least recently used models until the budget is met
+ *
+ * @access private
+ * @param  const CModelEntry *keep  entry being used right now
+ * @return void
+ */
+inline void CModelRegistry::_evict(const CModelEntry *keep)
+{
+    while (0 < _budget && _budget < _bytes) {
+        CModelEntry *victim = NULL;
+        for (auto &node : _entries) {
+            CModelEntry *entry = node.second.get();
+            if (entry == keep || entry->_pinned || !entry->_model) {
+                continue;
+            }
+            if (NULL == victim || entry->_lastUse.load() < victim->_lastUse.load()) {
+                victim = entry;
+            }
+        }
+        if (NULL == victim) {
+            return;
+        }
+
+        _bytes -= victim->_bytes.load();
+        victim->_bytes.store(0);
+        std::atomic_store(&victim->_model, model_t());
+        _evictions++;
+    }
+}
+
+/**
+ * take an entry out of the cache and its bytes out of the budget
+ *
+ * the registry mutex is held
+ *
+ * @access private
+ * @param  std::map<std::string, entry_t>::iterator it
+ * @return void
+ */
+inline void CModelRegistry::_retire(std::map<std::string, entry_t>::iterator it)
+{
+    CModelEntry &entry = *it->second;
+    _bytes -= entry._bytes.load();
+    entry._bytes.store(0);
+    entry._retired = true;
+    _entries.erase(it);
+}
+
+} // namespace croco
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace croco {
+
+/**
+ * CParallelReader
+ *
+ * copies byte ranges of a file into memory with large pread() calls
+ * spread over several threads, so that a cold model file is read with
+ * as many requests in flight as the storage can serve
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CParallelReader {
+
+public:
+    static const size_t CHUNK_SIZE = 64 << 20;
+
+    CParallelReader(const std::string& filename, size_t threads, size_t chunk = CHUNK_SIZE);
+    ~CParallelReader();
+    void add(size_t offset, char *dst, size_t length);
+    void run(void);
+
+private:
+    CParallelReader(const CParallelReader&) = delete;
+    CParallelReader& operator=(const CParallelReader&) = delete;
+
+    struct range_t {
+        size_t offset;
+        char *dst;
+        size_t length;
+    };
+
+    void _read(const range_t& range) const;
+
+    int _fd;
+    size_t _threads;
+    size_t _chunk;
+    std::string _filename;
+    std::vector<range_t> _ranges;
+}; // class CParallelReader
+
+/**
+ * constructor
+ *
+ * @access public
+ * @param  const std::string& filename
+ * @param  size_t threads
+ * @param  size_t chunk  bytes per pread()
+ */
+inline CParallelReader::CParallelReader(const std::string& filename, size_t threads, size_t chunk)
+    : _threads(std::max<size_t>(1, threads)), _chunk(std::max<size_t>(1, chunk)), _filename(filename)
+{
+    _fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (-1 == _fd) {
+        throw std::invalid_argument(filename + " cannot be opened for loading!");
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+/**
+ * destructor
+ *
+ * @access public
+ */
+inline CParallelReader::~CParallelReader()
+{
+    close(_fd);
+}
+
+/**
+ * queue a range, cut into chunks
+ *
+ * @access public
+ * @param  size_t offset  position in the file
+ * @param  char *dst
+ * @param  size_t length
+ * @return void
+ */
+inline void CParallelReader::add(size_t offset, char *dst, size_t length)
+{
+    for (size_t done = 0; done < length; done += _chunk) {
+        _ranges.push_back(range_t{offset + done, dst + done, std::min(_chunk, length - done)});
+    }
+}
+
+/**
+ * read every queued chunk, the first error is rethrown
+ *
+ * @access public
+ * @return void
+ */
+inline void CParallelReader::run(void)
+{
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto worker = [&]() {
+        size_t idx;
+        while (!failed.load() && (idx = next.fetch_add(1)) < _ranges.size()) {
+            try {
+                _read(_ranges[idx]);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                failed.store(true);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    size_t count = std::min(_threads, _ranges.size());
+    for (size_t idx = 1; idx < count; idx++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    _ranges.clear();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/**
+ * read one chunk
+ *
+ * @access private
+ * @param  const range_t& range
+ * @return void
+ */
+inline void CParallelReader::_read(const range_t& range) const
+{
+    size_t done = 0;
+    while (done < range.length) {
+        ssize_t bytes = pread(_fd, range.dst + done, range.length - done, static_cast<off_t>(range.offset + done));
+        if (0 > bytes) {
+            if (EINTR == errno) {
+                continue;
+            }
+            throw std::runtime_error(_filename + " cannot be read!");
+        }
+        if (0 == bytes) {
+            throw std::invalid_argument(_filename + " is truncated!");
+        }
+        done += static_cast<size_t>(bytes);
+    }
+}
+
+} // namespace croco
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef HAVE_FASTTEXT_PROBES
+#include <sys/sdt.h>
+
+#define FASTTEXT_PROBE2(name, a1, a2) DTRACE_PROBE2(fasttext, name, a1, a2)
+#define FASTTEXT_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(fasttext, name, a1, a2, a3, a4)
+#else
+#define FASTTEXT_PROBE2(name, a1, a2) do { (void)(a1); (void)(a2); } while (0)
+#define FASTTEXT_PROBE4(name, a1, a2, a3, a4) do { (void)(a1); (void)(a2); (void)(a3); (void)(a4); } while (0)
+#endif
+
+namespace croco {
+
+/**
+ * CProbe
+ *
+ * fires the fasttext:method__entry / method__return or
+ * fasttext:phase__entry / phase__return USDT probes around a scope.
+ * a probe site is a single nop until a tracer attaches to it, and
+ * without sys/sdt.h the whole class compiles away
+ *
+ * arguments: name, model id, input length, k (entry only)
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CProbe {
+
+public:
+    enum scope_t {
+        SCOPE_METHOD = 0,
+        SCOPE_PHASE
+    };
+
+    CProbe(scope_t scope, const char *name, const void *model, size_t len = 0, int64_t k = 0);
+    ~CProbe();
+
+private:
+    CProbe(const CProbe&) = delete;
+    CProbe& operator=(const CProbe&) = delete;
+
+    scope_t _scope;
+    const char *_name;
+    uintptr_t _model;
+}; // class CProbe
+
+/**
+ * constructor
+ *
+ * @access public
+ * @param  scope_t scope
+ * @param  const char *name  static string
+ * @param  const void *model
+ * @param  size_t len  bytes or tokens of the input
+ * @param  int64_t k
+ */
+inline CProbe::CProbe(scope_t scope, const char *name, const void *model, size_t len, int64_t k)
+    : _scope(scope), _name(name), _model(reinterpret_cast<uintptr_t>(model))
+{
+    if (SCOPE_METHOD == _scope) {
+        FASTTEXT_PROBE4(method__entry, _name, _model, len, k);
+    } else {
+        FASTTEXT_PROBE4(phase__entry, _name, _model, len, k);
+    }
+}
+
+/**
+ * destructor
+ *
+ * @access public
+ */
+inline CProbe::~CProbe()
+{
+    if (SCOPE_METHOD == _scope) {
+        FASTTEXT_PROBE2(method__return, _name, _model);
+    } else {
+        FASTTEXT_PROBE2(phase__return, _name, _model);
+    }
+}
+
+} // namespace croco
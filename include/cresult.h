@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fasttext/real.h>
+#include <fasttext/vector.h>
+
+namespace croco {
+
+/**
+ * CResult
+ *
+ * rows of a getPredict / getNN / getAnalogies / getNgrams call kept
+ * as native values until PHP reads them
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CResult {
+
+public:
+    typedef std::vector<std::pair<fasttext::real, std::string>> scores_t;
+    typedef std::vector<std::pair<std::string, fasttext::Vector>> ngrams_t;
+
+    enum kind_t {
+        KIND_PROB = 0,
+        KIND_SCORE,
+        KIND_NGRAM
+    };
+
+    CResult(kind_t kind, scores_t&& scores);
+    explicit CResult(ngrams_t&& ngrams);
+
+    kind_t kind(void) const;
+    size_t size(void) const;
+    const scores_t& scores(void) const;
+    const ngrams_t& ngrams(void) const;
+
+private:
+    kind_t _kind;
+    scores_t _scores;
+    ngrams_t _ngrams;
+}; // class CResult
+
+/**
+ * constructor
+ *
+ * @access public
+ * @param  kind_t kind  KIND_PROB or KIND_SCORE
+ * @param  scores_t&& scores
+ */
+inline CResult::CResult(kind_t kind, scores_t&& scores)
+    : _kind(kind), _scores(std::move(scores))
+{
+}
+
+/**
+ * constructor
+ *
+ * @access public
+ * @param  ngrams_t&& ngrams
+ */
+inline CResult::CResult(ngrams_t&& ngrams)
+    : _kind(KIND_NGRAM), _ngrams(std::move(ngrams))
+{
+}
+
+/**
+ * kind
+ *
+ * @access public
+ * @return kind_t
+ */
+inline CResult::kind_t CResult::kind(void) const
+{
+    return _kind;
+}
+
+/**
+ * size
+ *
+ * @access public
+ * @return size_t
+ */
+inline size_t CResult::size(void) const
+{
+    return (KIND_NGRAM == _kind) ? _ngrams.size() : _scores.size();
+}
+
+/**
+ * scores
+ *
+ * @access public
+ * @return const scores_t&
+ */
+inline const CResult::scores_t& CResult::scores(void) const
+{
+    return _scores;
+}
+
+/**
+ * ngrams
+ *
+ * @access public
+ * @return const ngrams_t&
+ */
+inline const CResult::ngrams_t& CResult::ngrams(void) const
+{
+    return _ngrams;
+}
+
+} // namespace croco
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <fasttext/real.h>
+
+namespace croco {
+
+/**
+ * CSimilarity
+ *
+ * dot products between two sets of row-major vectors. product() keeps
+ * a tile of the transposed right-hand side in cache and runs its inner
+ * loop over contiguous columns, a loop the compiler turns into packed
+ * multiply-adds without reordering any sum
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CSimilarity {
+
+public:
+    static const int64_t BLOCK_COLS = 256;
+    static const int64_t BLOCK_DIMS = 128;
+    static const int64_t BLOCK_ROWS = 4;
+
+    static fasttext::real cosine(const fasttext::real *a, const fasttext::real *b, int64_t dim);
+    static void normalize(fasttext::real *rows, int64_t n, int64_t dim);
+    static void transpose(const fasttext::real *rows, int64_t n, int64_t dim, std::vector<fasttext::real>& out);
+    static void product(
+        const fasttext::real *a,
+        int64_t begin,
+        int64_t end,
+        const fasttext::real *bt,
+        int64_t nb,
+        int64_t dim,
+        fasttext::real *c
+    );
+}; // class CSimilarity
+
+/**
+ * cosine
+ *
+ * @access public
+ * @param  const fasttext::real *a
+ * @param  const fasttext::real *b
+ * @param  int64_t dim
+ * @return fasttext::real  0 when either vector is zero
+ */
+inline fasttext::real CSimilarity::cosine(const fasttext::real *a, const fasttext::real *b, int64_t dim)
+{
+    double dot = 0.0, normA = 0.0, normB = 0.0;
+    for (int64_t idx = 0; idx < dim; idx++) {
+        dot += a[idx] * b[idx];
+        normA += a[idx] * a[idx];
+        normB += b[idx] * b[idx];
+    }
+    if (0.0 >= normA || 0.0 >= normB) {
+        return 0.0;
+    }
+    return static_cast<fasttext::real>(dot / (std::sqrt(normA) * std::sqrt(normB)));
+}
+
+/**
+ * scale every row to unit length, zero rows are left as they are
+ *
+ * @access public
+ * @param  fasttext::real *rows
+ * @param  int64_t n
+ * @param  int64_t dim
+ * @return void
+ */
+inline void CSimilarity::normalize(fasttext::real *rows, int64_t n, int64_t dim)
+{
+    for (int64_t i = 0; i < n; i++) {
+        fasttext::real *row = rows + i * dim;
+        double norm = 0.0;
+        for (int64_t k = 0; k < dim; k++) {
+            norm += row[k] * row[k];
+        }
+        if (0.0 < norm) {
+            fasttext::real scale = static_cast<fasttext::real>(1.0 / std::sqrt(norm));
+            for (int64_t k = 0; k < dim; k++) {
+                row[k] *= scale;
+            }
+        }
+    }
+}
+
+/**
+ * transpose
+ *
+ * @access public
+ * @param  const fasttext::real *rows  n x dim
+ * @param  int64_t n
+ * @param  int64_t dim
+ * @param  std::vector<fasttext::real>& out  dim x n
+ * @return void
+ */
+inline void CSimilarity::transpose(const fasttext::real *rows, int64_t n, int64_t dim, std::vector<fasttext::real>& out)
+{
+    out.resize(n * dim);
+    for (int64_t i = 0; i < n; i++) {
+        for (int64_t k = 0; k < dim; k++) {
+            out[k * n + i] = rows[i * dim + k];
+        }
+    }
+}
+
+/**
+ * c[i][j] = a[i] . b[j] for the rows [begin, end) of a
+ *
+ * disjoint row ranges can be computed on different threads
+ *
+ * @access public
+ * @param  const fasttext::real *a  na x dim
+ * @param  int64_t begin
+ * @param  int64_t end
+ * @param  const fasttext::real *bt  dim x nb, from transpose()
+ * @param  int64_t nb
+ * @param  int64_t dim
+ * @param  fasttext::real *c  na x nb
+ * @return void
+ */
+inline void CSimilarity::product(
+    const fasttext::real *a,
+    int64_t begin,
+    int64_t end,
+    const fasttext::real *bt,
+    int64_t nb,
+    int64_t dim,
+    fasttext::real *c
+)
+{
+    std::fill(c + begin * nb, c + end * nb, 0.0);
+
+    for (int64_t j0 = 0; j0 < nb; j0 += BLOCK_COLS) {
+        const int64_t j1 = std::min(nb, j0 + BLOCK_COLS);
+
+        for (int64_t k0 = 0; k0 < dim; k0 += BLOCK_DIMS) {
+            const int64_t k1 = std::min(dim, k0 + BLOCK_DIMS);
+
+            int64_t i = begin;
+            for (; i + BLOCK_ROWS <= end; i += BLOCK_ROWS) {
+                const fasttext::real *a0 = a + i * dim;
+                const fasttext::real *a1 = a0 + dim;
+                const fasttext::real *a2 = a1 + dim;
+                const fasttext::real *a3 = a2 + dim;
+                fasttext::real* __restrict c0 = c + i * nb;
+                fasttext::real* __restrict c1 = c0 + nb;
+                fasttext::real* __restrict c2 = c1 + nb;
+                fasttext::real* __restrict c3 = c2 + nb;
+
+                for (int64_t k = k0; k < k1; k++) {
+                    const fasttext::real* __restrict b = bt + k * nb;
+                    const fasttext::real w0 = a0[k], w1 = a1[k], w2 = a2[k], w3 = a3[k];
+                    for (int64_t j = j0; j < j1; j++) {
+                        c0[j] += w0 * b[j];
+                        c1[j] += w1 * b[j];
+                        c2[j] += w2 * b[j];
+                        c3[j] += w3 * b[j];
+                    }
+                }
+            }
+            for (; i < end; i++) {
+                const fasttext::real *a0 = a + i * dim;
+                fasttext::real* __restrict c0 = c + i * nb;
+
+                for (int64_t k = k0; k < k1; k++) {
+                    const fasttext::real* __restrict b = bt + k * nb;
+                    const fasttext::real w0 = a0[k];
+                    for (int64_t j = j0; j < j1; j++) {
+                        c0[j] += w0 * b[j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+} // namespace croco
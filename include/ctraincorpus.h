@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace croco {
+
+/**
+ * CTrainCorpus
+ *
+ * training text streamed from PHP into an anonymous in-memory file.
+ * fastText re-opens its input by name from every training thread and
+ * seeks to a per-thread offset each epoch, so the text has to be a
+ * seekable file; on Linux it lives in a memfd and is reachable through
+ * /proc/self/fd, elsewhere an unlinked-on-close temporary file is used
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CTrainCorpus {
+
+public:
+    CTrainCorpus();
+    ~CTrainCorpus();
+    void append(const char *line, size_t len);
+    void flush(void);
+    const std::string& path(void) const;
+    size_t lines(void) const;
+
+private:
+    CTrainCorpus(const CTrainCorpus&) = delete;
+    CTrainCorpus& operator=(const CTrainCorpus&) = delete;
+
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    int _fd;
+    bool _unlink;
+    size_t _lines;
+    std::string _path;
+    std::string _buffer;
+}; // class CTrainCorpus
+
+/**
+ * constructor
+ *
+ * @access public
+ */
+inline CTrainCorpus::CTrainCorpus() : _fd(-1), _unlink(false), _lines(0)
+{
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    _fd = memfd_create("fasttext-corpus", MFD_CLOEXEC);
+    if (-1 != _fd) {
+        _path = "/proc/self/fd/" + std::to_string(_fd);
+    }
+#endif
+    if (-1 == _fd) {
+        const char *tmpdir = getenv("TMPDIR");
+        std::string tmpl = std::string(tmpdir ? tmpdir : "/tmp") + "/fasttext-corpus-XXXXXX";
+        _fd = mkstemp(&tmpl[0]);
+        if (-1 == _fd) {
+            throw std::runtime_error("cannot create the training corpus");
+        }
+        _path = tmpl;
+        _unlink = true;
+    }
+    _buffer.reserve(BUFFER_SIZE);
+}
+
+/**
+ * destructor
+ *
+ * @access public
+ */
+inline CTrainCorpus::~CTrainCorpus()
+{
+    close(_fd);
+    if (_unlink) {
+        unlink(_path.c_str());
+    }
+}
+
+/**
+ * append one line, a trailing newline is added when missing
+ *
+ * @access public
+ * @param  const char *line
+ * @param  size_t len
+ * @return void
+ */
+inline void CTrainCorpus::append(const char *line, size_t len)
+{
+    _buffer.append(line, len);
+    if (0 == len || '\n' != line[len - 1]) {
+        _buffer.push_back('\n');
+    }
+    _lines++;
+
+    if (_buffer.size() >= BUFFER_SIZE) {
+        flush();
+    }
+}
+
+/**
+ * flush
+ *
+ * @access public
+ * @return void
+ */
+inline void CTrainCorpus::flush(void)
+{
+    const char *data = _buffer.data();
+    size_t left = _buffer.size();
+    while (0 < left) {
+        ssize_t written = write(_fd, data, left);
+        if (0 > written) {
+            if (EINTR == errno) {
+                continue;
+            }
+            throw std::runtime_error("cannot write the training corpus");
+        }
+        data += written;
+        left -= static_cast<size_t>(written);
+    }
+    _buffer.clear();
+}
+
+/**
+ * path
+ *
+ * @access public
+ * @return const std::string&
+ */
+inline const std::string& CTrainCorpus::path(void) const
+{
+    return _path;
+}
+
+/**
+ * lines
+ *
+ * @access public
+ * @return size_t
+ */
+inline size_t CTrainCorpus::lines(void) const
+{
+    return _lines;
+}
+
+} // namespace croco
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace croco {
+
+/**
+ * CWorkerPool
+ *
+ * fixed size pool of native threads draining a FIFO job queue
+ *
+ * @package     croco-fastText
+ * @author      Yujiro Takahashi <yujiro@cro-co.co.jp>
+ */
+class CWorkerPool {
+
+public:
+    typedef std::function<void()> job_t;
+
+    explicit CWorkerPool(size_t threads);
+    ~CWorkerPool();
+    void submit(job_t job);
+    void shutdown(void);
+    size_t size(void) const;
+
+private:
+    void _run(void);
+
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::queue<job_t> _jobs;
+    std::vector<std::thread> _threads;
+    bool _stop;
+}; // class CWorkerPool
+
+/**
+ * constructor
+ *
+ * @access public
+ * @param  size_t threads
+ */
+inline CWorkerPool::CWorkerPool(size_t threads) : _stop(false)
+{
+    if (0 == threads) {
+        threads = 1;
+    }
+    for (size_t idx = 0; idx < threads; idx++) {
+        _threads.emplace_back(&CWorkerPool::_run, this);
+    }
+}
+
+/**
+ * destructor
+ *
+ * @access public
+ */
+inline CWorkerPool::~CWorkerPool()
+{
+    shutdown();
+}
+
+/**
+ * submit
+ *
+ * @access public
+ * @param  job_t job
+ * @return void
+ */
+inline void CWorkerPool::submit(job_t job)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stop) {
+            throw std::runtime_error("worker pool is shut down");
+        }
+        _jobs.push(std::move(job));
+    }
+    _cond.notify_one();
+}
+
+/**
+ * finish the queued jobs and join every thread
+ *
+ * @access public
+ * @return void
+ */
+inline void CWorkerPool::shutdown(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stop) {
+            return;
+        }
+        _stop = true;
+    }
+    _cond.notify_all();
+
+    for (auto &thread : _threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+/**
+ * size
+ *
+ * @access public
+ * @return size_t
+ */
+inline size_t CWorkerPool::size(void) const
+{
+    return _threads.size();
+}
+
+/**
+ * thread main loop
+ *
+ * @access private
+ * @return void
+ */
+inline void CWorkerPool::_run(void)
+{
+    for (;;) {
+        job_t job;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, [this] { return _stop || !_jobs.empty(); });
+            if (_jobs.empty()) {
+                return;
+            }
+            job = std::move(_jobs.front());
+            _jobs.pop();
+        }
+        job();
+    }
+}
+
+} // namespace croco
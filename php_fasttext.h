@@ -8,8 +8,14 @@ extern zend_module_entry fasttext_module_entry;
 
 ZEND_BEGIN_MODULE_GLOBALS(fasttext)
 	char *model_dir;
+	zend_long oov_cache_size;
+	zend_long threads;
+	zend_bool share_models;
+	zend_long cache_budget;
 ZEND_END_MODULE_GLOBALS(fasttext)
 
+ZEND_EXTERN_MODULE_GLOBALS(fasttext)
+
 #ifdef ZTS
 # define FASTTEXT_G(v) TSRMG(fasttext_globals_id, zend_fasttext_globals *, v)
 # ifdef COMPILE_DL_FASTTEXT